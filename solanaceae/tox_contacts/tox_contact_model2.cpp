@@ -1,6 +1,5 @@
 #include "./tox_contact_model2.hpp"
 
-#include <solanaceae/util/time.hpp>
 #include <solanaceae/util/utils.hpp>
 
 #include <solanaceae/toxcore/tox_interface.hpp>
@@ -15,9 +14,10 @@
 
 #include "./components.hpp"
 
+#include <solanaceae/tox_util/log.hpp>
+
 #include <algorithm>
 #include <string_view>
-#include <iostream>
 
 static bool contact_tox_group_message_is_same(Message3Handle lh, Message3Handle rh) {
 	if (!lh.all_of<Message::Components::ToxGroupMessageID>() || !rh.all_of<Message::Components::ToxGroupMessageID>()) {
@@ -103,6 +103,9 @@ ToxContactModel2::~ToxContactModel2(void) {
 }
 
 void ToxContactModel2::iterate(float delta) {
+	// the events before this are done
+	_tick_clock.tick();
+
 	// continually fetch group peer connection state, since JF does not want to add cb/event
 	_group_status_timer += delta;
 	// every second
@@ -169,6 +172,9 @@ void ToxContactModel2::iterate(float delta) {
 			_cs.throwEventUpdate(c);
 		}
 	}
+
+	// dont leak this frames time into the next event batch
+	_tick_clock.tick();
 }
 
 bool ToxContactModel2::addContact(Contact4 c) {
@@ -196,7 +202,7 @@ bool ToxContactModel2::acceptRequest(Contact4 c, std::string_view self_name, std
 			cr.emplace<Contact::Components::ToxFriendEphemeral>(c, friend_number_opt.value());
 			cr.remove<Contact::Components::RequestIncoming>(c);
 		} else {
-			std::cerr << "TCM2 error: failed to accept friend request/invite\n";
+			TOX_LOG_ERROR("TCM2") << "failed to accept friend request/invite";
 			return false;
 		}
 	} else if (false) { // conf
@@ -204,7 +210,7 @@ bool ToxContactModel2::acceptRequest(Contact4 c, std::string_view self_name, std
 		const auto& ir = cr.get<Contact::Components::ToxGroupIncomingRequest>(c);
 		auto [group_number_opt, _] = _t.toxGroupInviteAccept(ir.friend_number, ir.invite_data, self_name, password);
 		if (!group_number_opt.has_value()) {
-			std::cerr << "TCM2 error: failed to accept group request/invite\n";
+			TOX_LOG_ERROR("TCM2") << "failed to accept group request/invite";
 			return false;
 		}
 
@@ -214,7 +220,7 @@ bool ToxContactModel2::acceptRequest(Contact4 c, std::string_view self_name, std
 		cr.remove<Contact::Components::ToxGroupIncomingRequest>(c);
 		cr.remove<Contact::Components::RequestIncoming>(c);
 	} else {
-		std::cerr << "TCM2 error: failed to accept request (unk)\n";
+		TOX_LOG_ERROR("TCM2") << "failed to accept request (unk)";
 		return false;
 	}
 
@@ -230,7 +236,7 @@ bool ToxContactModel2::leave(Contact4 c, std::string_view reason) {
 
 bool ToxContactModel2::invite(Contact4 c, Contact4 to) {
 	if (!canInvite(c, to)) {
-		std::cerr << "TCM error: could not invite\n";
+		TOX_LOG_ERROR("TCM") << "could not invite";
 		return false;
 	}
 
@@ -239,7 +245,7 @@ bool ToxContactModel2::invite(Contact4 c, Contact4 to) {
 	{ // friend online check
 		const auto* cs = cr.try_get<Contact::Components::ConnectionState>(c);
 		if (!cs || cs->state == Contact::Components::ConnectionState::disconnected) {
-			std::cerr << "TCM error: friend offline, could not invite\n";
+			TOX_LOG_ERROR("TCM") << "friend offline, could not invite";
 			return false;
 		}
 	}
@@ -250,12 +256,12 @@ bool ToxContactModel2::invite(Contact4 c, Contact4 to) {
 			cr.get<Contact::Components::ToxFriendEphemeral>(c).friend_number
 		);
 
-		std::cerr << "TCM: invited (" << err << ")\n";
+		TOX_LOG_INFO("TCM") << "invited (" << err << ")";
 
 		return err == Tox_Err_Group_Invite_Friend::TOX_ERR_GROUP_INVITE_FRIEND_OK;
 	}
 
-	std::cerr << "TCM error: unimplemented invite branch\n";
+	TOX_LOG_ERROR("TCM") << "unimplemented invite branch";
 	return false;
 }
 
@@ -401,7 +407,7 @@ ContactHandle4 ToxContactModel2::getContactFriend(uint32_t friend_number) {
 	cr.emplace_or_replace<Contact::Components::Name>(c, _t.toxFriendGetName(friend_number).value_or("<unk>"));
 	cr.emplace_or_replace<Contact::Components::StatusText>(c, _t.toxFriendGetStatusMessage(friend_number).value_or("")).fillFirstLineLength();
 
-	const auto ts = getTimeMS();
+	const auto ts = _tick_clock.now();
 
 	if (!cr.all_of<Contact::Components::LastSeen>(c)) {
 		auto lo_opt = _t.toxFriendGetLastOnline(friend_number);
@@ -424,7 +430,7 @@ ContactHandle4 ToxContactModel2::getContactFriend(uint32_t friend_number) {
 		}
 	}
 
-	std::cout << "TCM2: initialized friend contact " << friend_number << "\n";
+	TOX_LOG_DEBUG("TCM2") << "initialized friend contact " << friend_number;
 
 	if (created) {
 		_cs.throwEventConstruct(c);
@@ -518,10 +524,10 @@ ContactHandle4 ToxContactModel2::getContactGroup(uint32_t group_number) {
 	if (self_opt.has_value()) {
 		cr.emplace_or_replace<Contact::Components::Self>(c, getContactGroupPeer(group_number, self_opt.value()));
 	} else {
-		std::cerr << "TCM2 error: getting self for group" << group_number << "!!\n";
+		TOX_LOG_ERROR("TCM2") << "getting self for group" << group_number << "!!";
 	}
 
-	std::cout << "TCM2: initialized group contact " << group_number << "\n";
+	TOX_LOG_DEBUG("TCM2") << "initialized group contact " << group_number;
 
 	if (created) {
 		_cs.throwEventConstruct(c);
@@ -561,7 +567,7 @@ ContactHandle4 ToxContactModel2::getContactGroupPeer(uint32_t group_number, uint
 	if (!g_p_key_opt.has_value()) {
 		// if the key could not be retreived, that means the peer has exited (idk why the earlier search did not work, it should have)
 		// also exit here, to not create, pubkey less <.<
-		std::cerr << "TCM2 error: we did not have offline peer in db, which is worrying\n";
+		TOX_LOG_ERROR("TCM2") << "we did not have offline peer in db, which is worrying";
 		return {};
 	}
 
@@ -631,11 +637,11 @@ ContactHandle4 ToxContactModel2::getContactGroupPeer(uint32_t group_number, uint
 				cr.emplace_or_replace<Contact::Components::Self>(c, getContactGroupPeer(group_number, self_number_opt.value()));
 			}
 		} else {
-			std::cerr << "TCM2 error: getting self for group" << group_number << "!!\n";
+			TOX_LOG_ERROR("TCM2") << "getting self for group" << group_number << "!!";
 		}
 	}
 
-	std::cout << "TCM2: initialized group peer contact " << group_number << " " << peer_number << "\n";
+	TOX_LOG_DEBUG("TCM2") << "initialized group peer contact " << group_number << " " << peer_number;
 
 	if (created) {
 		_cs.throwEventConstruct(c);
@@ -707,7 +713,7 @@ ContactHandle4 ToxContactModel2::getContactGroupPeer(uint32_t group_number, cons
 		cr.emplace_or_replace<Contact::Components::Self>(c, getContactGroupPeer(group_number, self_number_opt.value()));
 	}
 
-	std::cout << "TCM2: created group peer contact via pubkey " << group_number << "\n";
+	TOX_LOG_INFO("TCM2") << "created group peer contact via pubkey " << group_number;
 
 	if (created) {
 		_cs.throwEventConstruct(c);
@@ -755,7 +761,7 @@ bool ToxContactModel2::onToxEvent(const Tox_Event_Friend_Connection_Status* e) {
 	if (connection_status == TOX_CONNECTION_NONE) {
 		c.remove<Contact::Components::ToxFriendEphemeral>();
 	} else {
-		const auto ts = getTimeMS();
+		const auto ts = _tick_clock.now();
 
 		c.emplace_or_replace<Contact::Components::LastSeen>(ts);
 
@@ -830,7 +836,7 @@ bool ToxContactModel2::onToxEvent(const Tox_Event_Friend_Request* e) {
 		cr.emplace_or_replace<Contact::Components::RequestIncoming>(c);
 		cr.remove<Contact::Components::ToxFriendEphemeral>(c);
 
-		std::cout << "TCM2: marked friend contact as requested\n";
+		TOX_LOG_INFO("TCM2") << "marked friend contact as requested";
 
 		_cs.throwEventUpdate(c);
 
@@ -859,7 +865,7 @@ bool ToxContactModel2::onToxEvent(const Tox_Event_Friend_Request* e) {
 	cr.emplace_or_replace<Contact::Components::TagPrivate>(c);
 	cr.emplace_or_replace<Contact::Components::Self>(c, _friend_self);
 
-	std::cout << "TCM2: created friend contact (requested)\n";
+	TOX_LOG_INFO("TCM2") << "created friend contact (requested)";
 
 	if (created) {
 		_cs.throwEventConstruct(c);
@@ -893,7 +899,7 @@ bool ToxContactModel2::onToxEvent(const Tox_Event_Group_Invite* e) {
 	}
 
 	if (cr.valid(c)) {
-		std::cout << "TCM2: already in group from invite\n";
+		TOX_LOG_INFO("TCM2") << "already in group from invite";
 		return false;
 	}
 
@@ -933,7 +939,7 @@ bool ToxContactModel2::onToxEvent(const Tox_Event_Group_Invite* e) {
 
 	// there is no self yet
 
-	std::cout << "TCM2: created group contact (requested)\n";
+	TOX_LOG_INFO("TCM2") << "created group contact (requested)";
 
 	if (created) {
 		_cs.throwEventConstruct(c);
@@ -993,7 +999,7 @@ bool ToxContactModel2::onToxEvent(const Tox_Event_Group_Peer_Join* e) {
 		Contact::Components::ConnectionState::State::cloud
 	);
 
-	const auto ts = getTimeMS();
+	const auto ts = _tick_clock.now();
 
 	c.emplace_or_replace<Contact::Components::LastSeen>(ts);
 
@@ -1020,7 +1026,7 @@ bool ToxContactModel2::onToxEvent(const Tox_Event_Group_Peer_Exit* e) {
 	// we dont care about the part messae?
 
 	if (exit_type == Tox_Group_Exit_Type::TOX_GROUP_EXIT_TYPE_SELF_DISCONNECTED) {
-		std::cout << "TCM: ngc self exit intentionally/rejoin/kicked\n";
+		TOX_LOG_INFO("TCM") << "ngc self exit intentionally/rejoin/kicked";
 		// you disconnected/reconnected intentionally, or you where kicked
 		// TODO: we need to remove all ToxGroupPeerEphemeral components of that group
 		// do we? there is an event for every peer except ourselfs
@@ -1029,7 +1035,7 @@ bool ToxContactModel2::onToxEvent(const Tox_Event_Group_Peer_Exit* e) {
 	auto c = getContactGroupPeer(group_number, peer_number);
 
 	if (!static_cast<bool>(c)) {
-		std::cerr << "TCM warning: not tracking ngc peer?\n";
+		TOX_LOG_WARNING("TCM") << "not tracking ngc peer?";
 		return false; // we dont track this contact ?????
 	}
 
@@ -5,6 +5,8 @@
 
 #include <solanaceae/toxcore/tox_key.hpp>
 
+#include <solanaceae/tox_util/tick_clock.hpp>
+
 // fwd
 struct ToxI;
 struct ToxPrivateI;
@@ -21,6 +23,9 @@ class ToxContactModel2 : public ContactModel4I, public ToxEventI {
 
 	float _group_status_timer {0.f};
 
+	// shared with the other tox managers, ticked in iterate()
+	ToxTickClock _tick_clock;
+
 	public:
 		static constexpr const char* version {"4"};
 
@@ -29,6 +34,8 @@ class ToxContactModel2 : public ContactModel4I, public ToxEventI {
 
 		void iterate(float delta);
 
+		ToxTickClock& tickClock(void) { return _tick_clock; }
+
 	protected: // mmi
 		bool addContact(Contact4 c) override;
 
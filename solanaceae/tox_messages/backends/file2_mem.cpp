@@ -0,0 +1,52 @@
+#include "./file2_mem.hpp"
+
+#include <algorithm>
+
+File2MemRW::File2MemRW(std::shared_ptr<std::vector<uint8_t>> data, bool can_write) : File2I(can_write, true), _data(std::move(data)) {
+}
+
+File2MemRW::~File2MemRW(void) {
+}
+
+bool File2MemRW::isGood(void) {
+	return static_cast<bool>(_data);
+}
+
+bool File2MemRW::write(const ByteSpan data, int64_t pos) {
+	if (!can_write || !_data) {
+		return false;
+	}
+
+	if (pos < 0) {
+		pos = _pos;
+	}
+
+	if (uint64_t(pos) + data.size > _data->size()) {
+		_data->resize(pos + data.size);
+	}
+	std::copy(data.cbegin(), data.cend(), _data->begin() + pos);
+	_pos = pos + data.size;
+
+	return true;
+}
+
+ByteSpanWithOwnership File2MemRW::read(uint64_t size, int64_t pos) {
+	if (!_data) {
+		return ByteSpan{};
+	}
+
+	if (pos < 0) {
+		pos = _pos;
+	}
+
+	if (uint64_t(pos) >= _data->size()) {
+		return ByteSpan{};
+	}
+
+	size = std::min<uint64_t>(size, _data->size() - pos);
+	_pos = pos + size;
+
+	// the buffer might grow or go away, so no span
+	return std::vector<uint8_t>(_data->cbegin() + pos, _data->cbegin() + pos + size);
+}
+
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <solanaceae/file/file2.hpp>
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// read/write file in memory, the data is shared with the owner (eg a component).
+// writes past the end grow the buffer.
+struct File2MemRW : public File2I {
+	std::shared_ptr<std::vector<uint8_t>> _data;
+	uint64_t _pos {0}; // for stream reads/writes
+
+	File2MemRW(std::shared_ptr<std::vector<uint8_t>> data, bool can_write = true);
+	virtual ~File2MemRW(void);
+
+	bool isGood(void) override;
+
+	bool write(const ByteSpan data, int64_t pos = -1) override;
+
+	// copies
+	ByteSpanWithOwnership read(uint64_t size, int64_t pos = -1) override;
+};
+
@@ -0,0 +1,132 @@
+#include "./file2_mmap.hpp"
+
+#include <string>
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+	#include <filesystem>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+File2MMapR::File2MMapR(std::string_view file_path) : File2I(false, true) {
+#ifdef _WIN32
+	const auto wpath = std::filesystem::u8path(file_path).wstring();
+	HANDLE file = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	_file_handle = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		return;
+	}
+	_file_size = int64_t(size.QuadPart);
+
+	if (_file_size == 0) {
+		_good = true; // cant map empty files
+		return;
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		return;
+	}
+	_mapping_handle = mapping;
+
+	_data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	_good = _data != nullptr;
+#else
+	const int fd = ::open(std::string{file_path}.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		::close(fd);
+		return;
+	}
+	_file_size = int64_t(st.st_size);
+
+	if (_file_size == 0) {
+		::close(fd);
+		_good = true; // cant map empty files
+		return;
+	}
+
+	void* ptr = ::mmap(nullptr, _file_size, PROT_READ, MAP_SHARED, fd, 0);
+	// the mapping keeps the file referenced
+	::close(fd);
+	if (ptr == MAP_FAILED) {
+		return;
+	}
+
+	// transfers mostly read front to back
+	::madvise(ptr, _file_size, MADV_SEQUENTIAL);
+
+	_data = static_cast<const uint8_t*>(ptr);
+	_good = true;
+#endif
+}
+
+File2MMapR::~File2MMapR(void) {
+#ifdef _WIN32
+	if (_data != nullptr) {
+		UnmapViewOfFile(_data);
+	}
+	if (_mapping_handle != nullptr) {
+		CloseHandle(_mapping_handle);
+	}
+	if (_file_handle != nullptr) {
+		CloseHandle(_file_handle);
+	}
+#else
+	if (_data != nullptr) {
+		::munmap(const_cast<uint8_t*>(_data), _file_size);
+	}
+#endif
+}
+
+bool File2MMapR::isGood(void) {
+	return _good;
+}
+
+bool File2MMapR::write(const ByteSpan, int64_t) {
+	return false;
+}
+
+ByteSpanWithOwnership File2MMapR::read(uint64_t size, int64_t pos) {
+	if (pos < 0) {
+		pos = _pos;
+	}
+
+	const ByteSpan res = span(pos, size);
+	_pos = pos + res.size;
+
+	// non owning
+	return res;
+}
+
+ByteSpan File2MMapR::span(uint64_t pos, uint64_t size) const {
+	if (_data == nullptr || _file_size < 0 || pos >= uint64_t(_file_size)) {
+		return {};
+	}
+
+	if (size > uint64_t(_file_size) - pos) {
+		size = uint64_t(_file_size) - pos;
+	}
+
+	return {_data + pos, size};
+}
+
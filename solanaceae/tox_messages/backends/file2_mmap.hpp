@@ -0,0 +1,41 @@
+#pragma once
+
+#include <solanaceae/file/file2.hpp>
+
+#include <string_view>
+#include <cstdint>
+
+// read only, memory mapped file.
+// reads return non owning spans into the mapping, so concurrent readers of the
+// same file share the page cache and nothing is copied.
+// NOTE: truncating the file while mapped will crash (SIGBUS) on access,
+// so only use it for files that are not modified while sending.
+// the size is File2I::_file_size.
+struct File2MMapR : public File2I {
+	const uint8_t* _data {nullptr};
+	uint64_t _pos {0}; // for stream reads
+
+	bool _good {false};
+
+#ifdef _WIN32
+	void* _file_handle {nullptr};
+	void* _mapping_handle {nullptr};
+#endif
+
+	File2MMapR(std::string_view file_path);
+	virtual ~File2MMapR(void);
+
+	File2MMapR(const File2MMapR&) = delete;
+	File2MMapR& operator=(const File2MMapR&) = delete;
+
+	bool isGood(void) override;
+
+	// always fails
+	bool write(const ByteSpan data, int64_t pos = -1) override;
+
+	ByteSpanWithOwnership read(uint64_t size, int64_t pos = -1) override;
+
+	// direct access, clamped to the file size
+	ByteSpan span(uint64_t pos, uint64_t size) const;
+};
+
@@ -1,11 +1,21 @@
 #include "./tox_ft_filesystem.hpp"
 
+#include "./file2_mmap.hpp"
+
 #include <solanaceae/object_store/meta_components.hpp>
 #include <solanaceae/object_store/meta_components_file.hpp>
 
 #include <solanaceae/file/file2_std.hpp>
 
-#include <iostream>
+#include <solanaceae/tox_util/log.hpp>
+
+#include <filesystem>
+#include <cassert>
+
+#if !defined(_WIN32)
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
 
 namespace Backends {
 
@@ -34,20 +44,16 @@ ObjectHandle ToxFTFilesystem::newObject(ByteSpan id, bool throw_construct) {
 
 std::unique_ptr<File2I> ToxFTFilesystem::file2(Object ov, FILE2_FLAGS flags) {
 	if (flags & FILE2_RAW) {
-		std::cerr << "TFTF error: does not support raw modes\n";
+		TOX_LOG_ERROR("TFTF") << "does not support raw modes";
 		return nullptr;
 	}
 
 	if (flags == FILE2_NONE) {
-		std::cerr << "TFTF error: no file mode set\n";
+		TOX_LOG_ERROR("TFTF") << "no file mode set";
 		assert(false);
 		return nullptr;
 	}
 
-	if (flags & FILE2_WRITE) {
-		std::cerr << "TFTF error: opening file in write mode not supported\n";
-	}
-
 	ObjectHandle o{_os.registry(), ov};
 
 	if (!static_cast<bool>(o)) {
@@ -65,16 +71,73 @@ std::unique_ptr<File2I> ToxFTFilesystem::file2(Object ov, FILE2_FLAGS flags) {
 		return nullptr;
 	}
 
+	uint64_t file_size {0};
+	if (const auto* si = o.try_get<ObjComp::F::SingleInfo>(); si != nullptr && si->file_size != UINT64_MAX) {
+		file_size = si->file_size;
+	} else {
+		// unknown size (streaming)
+		std::error_code ec;
+		file_size = std::filesystem::file_size(std::filesystem::u8path(file_path), ec);
+	}
+
+	if (flags & FILE2_WRITE) {
+		// reopening a (partially) received file, keep the content
+		const bool streaming = o.all_of<ObjComp::F::SingleInfo>() && o.get<ObjComp::F::SingleInfo>().file_size == UINT64_MAX;
+		auto res = std::make_unique<File2RWFile>(file_path, streaming ? -1 : int64_t(file_size), false);
+		if (!res->isGood()) {
+			TOX_LOG_ERROR("TFTF") << "failed opening file '" << file_path << "' for writing";
+			return nullptr;
+		}
+		return res;
+	}
+
 	// read only
+	return openFileRead(file_path, file_size);
+}
+
+std::unique_ptr<File2I> ToxFTFilesystem::openFileRead(std::string_view file_path, uint64_t file_size) {
+	if (file_size >= _mmap_threshold) {
+		auto res = std::make_unique<File2MMapR>(file_path);
+		if (res->isGood()) {
+			return res;
+		}
+		TOX_LOG_WARNING("TFTF") << "failed mapping file '" << file_path << "', falling back to stream";
+	}
+
 	auto res = std::make_unique<File2RFile>(file_path);
 
 	if (!res || !res->isGood()) {
-		std::cerr << "TFTF error: failed constructing file '" << file_path << "'\n";
+		TOX_LOG_ERROR("TFTF") << "failed constructing file '" << file_path << "'";
 		return nullptr;
 	}
 
 	return res;
 }
 
+bool ToxFTFilesystem::preallocate(std::string_view file_path, uint64_t file_size) {
+#if defined(_WIN32) || defined(__APPLE__)
+	// TODO: SetFileInformationByHandle(FileAllocationInfo) / F_PREALLOCATE
+	(void)file_path;
+	(void)file_size;
+	return false;
+#else
+	const int fd = ::open(std::string{file_path}.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+
+	// allocates blocks, unwritten parts read as zero
+	const int err = ::posix_fallocate(fd, 0, file_size);
+	::close(fd);
+
+	if (err != 0) {
+		TOX_LOG_DEBUG("TFTF") << "preallocating " << file_size << " bytes failed (" << err << ")";
+		return false;
+	}
+
+	return true;
+#endif
+}
+
 } // Backends
 
@@ -2,11 +2,19 @@
 
 #include <solanaceae/object_store/object_store.hpp>
 
+#include <string_view>
+#include <memory>
+#include <cstdint>
+
 namespace Backends {
 
 struct ToxFTFilesystem : public StorageBackendIMeta, public StorageBackendIFile2 {
 	ObjectStore2& _os;
 
+	// local files at least this big are memory mapped for reading.
+	// off by default, a file truncated while mapped crashes (SIGBUS)
+	uint64_t _mmap_threshold {UINT64_MAX};
+
 	ToxFTFilesystem(
 		ObjectStore2& os
 	);
@@ -15,6 +23,17 @@ struct ToxFTFilesystem : public StorageBackendIMeta, public StorageBackendIFile2
 	ObjectHandle newObject(ByteSpan id, bool throw_construct = true) override;
 
 	std::unique_ptr<File2I> file2(Object o, FILE2_FLAGS flags) override;
+
+	// eg 4MiB, for files that do not change while being sent. UINT64_MAX disables
+	void setMMapThreshold(uint64_t size) { _mmap_threshold = size; }
+
+	// read only, picks mmap or stream based on size
+	std::unique_ptr<File2I> openFileRead(std::string_view file_path, uint64_t file_size);
+
+	// creates (or truncates) a file about to be received and reserves its disk space.
+	// open it afterwards without truncating.
+	// false if not supported or failed
+	static bool preallocate(std::string_view file_path, uint64_t file_size);
 };
 
 } // Backends
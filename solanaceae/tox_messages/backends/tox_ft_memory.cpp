@@ -0,0 +1,47 @@
+#include "./tox_ft_memory.hpp"
+
+#include "./file2_mem.hpp"
+#include "../obj_components.hpp"
+
+#include <solanaceae/object_store/meta_components_file.hpp>
+
+#include <solanaceae/tox_util/log.hpp>
+
+namespace Backends {
+
+ToxFTMemory::ToxFTMemory(
+	ObjectStore2& os
+) : _os(os) {
+}
+
+ToxFTMemory::~ToxFTMemory(void) {
+}
+
+std::unique_ptr<File2I> ToxFTMemory::file2(Object ov, FILE2_FLAGS flags) {
+	if (flags & FILE2_RAW) {
+		TOX_LOG_ERROR("TFTM") << "does not support raw modes";
+		return nullptr;
+	}
+
+	ObjectHandle o{_os.registry(), ov};
+	if (!static_cast<bool>(o)) {
+		return nullptr;
+	}
+
+	const auto* mem_ptr = o.try_get<ObjComp::Ephemeral::ToxMemoryFile>();
+	if (mem_ptr == nullptr || !mem_ptr->data) {
+		return nullptr;
+	}
+
+	// complete data can be shared (avatar cache, objects of the same avatar),
+	// writing it would change all of them
+	if ((flags & FILE2_WRITE) && o.all_of<ObjComp::F::TagLocalHaveAll>()) {
+		TOX_LOG_ERROR("TFTM") << "complete memory files are read only";
+		return nullptr;
+	}
+
+	return std::make_unique<File2MemRW>(mem_ptr->data, (flags & FILE2_WRITE) != 0);
+}
+
+} // Backends
+
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <solanaceae/object_store/object_store.hpp>
+
+#include <memory>
+
+namespace Backends {
+
+// file2 of objects kept entirely in memory (ObjComp::Ephemeral::ToxMemoryFile),
+// eg avatars. the data is gone with the object.
+// complete objects (TagLocalHaveAll) are read only, their data may be shared
+struct ToxFTMemory : public StorageBackendIFile2 {
+	ObjectStore2& _os;
+
+	ToxFTMemory(
+		ObjectStore2& os
+	);
+	~ToxFTMemory(void);
+
+	std::unique_ptr<File2I> file2(Object o, FILE2_FLAGS flags) override;
+};
+
+} // Backends
+
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <solanaceae/tox_messages/obj_components.hpp>
+
+#include <nlohmann/json.hpp>
+
+namespace ObjectStore::Components::Tox {
+
+	// so an interrupted receive can be resumed after a restart
+	NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ReceivedRanges, ranges)
+
+} // ObjectStore::Components::Tox
+
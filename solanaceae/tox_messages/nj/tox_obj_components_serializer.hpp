@@ -0,0 +1,11 @@
+#pragma once
+
+#include <solanaceae/object_store/serializer_json.hpp>
+#include "./tox_obj_components.hpp"
+
+// for meta backends that persist objects
+inline void registerToxObjComponents(SerializerJsonCallbacks<Object>& sjc) {
+	sjc.registerSerializer<ObjectStore::Components::Tox::ReceivedRanges>();
+	sjc.registerDeserializer<ObjectStore::Components::Tox::ReceivedRanges>();
+}
+
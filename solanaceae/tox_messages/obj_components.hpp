@@ -7,6 +7,11 @@
 
 #include <solanaceae/toxcore/tox_key.hpp>
 
+#include <array>
+#include <vector>
+#include <memory>
+#include <utility>
+
 namespace ObjectStore::Components {
 
 	namespace Tox {
@@ -23,6 +28,22 @@ namespace ObjectStore::Components {
 			uint64_t kind {0};
 		};
 
+		// parts of an incoming file written to disk, [begin, end) sorted and merged.
+		// an interrupted transfer of the same FileID continues from the first gap
+		struct ReceivedRanges {
+			std::vector<std::pair<uint64_t, uint64_t>> ranges;
+		};
+
+		// BLAKE2b-256 of the file content, computed while transferring
+		struct ContentHash {
+			std::array<uint8_t, 32> hash {};
+			// the FileID is the content hash, so the content is verified against it.
+			// only re-shared objects have hash derived ids (sendFileObj() with a
+			// known hash), other FileIDs are random and never match.
+			// so false is not an error, just not verified
+			bool file_id_match {false};
+		};
+
 		// temporary replacement for Sending/Receiving
 		// TODO: something generic in os ?????
 		struct TagIncomming {};
@@ -48,6 +69,42 @@ namespace ObjectStore::Components {
 			Message3Handle m;
 		};
 
+		// the file content, for objects that only live in memory (Backends::ToxFTMemory).
+		// shared, eg. between the avatar cache and every object of the same avatar
+		struct ToxMemoryFile {
+			std::shared_ptr<std::vector<uint8_t>> data;
+		};
+
+		// user set, transfers with higher priority are scheduled first
+		struct ToxTransferPriority {
+			int32_t priority {0};
+		};
+
+		// outgoing, waiting for the friend to come online (or a free slot)
+		struct ToxTransferQueued {
+			uint64_t ts {0}; // when it was queued
+		};
+
+		// maintained by the transfer manager while the transfer is active,
+		// zeroed once it ends. in bytes per second
+		struct ToxTransferRate {
+			// over the last window
+			float up {0.f};
+			float down {0.f};
+
+			// exponentially weighted moving average of the above
+			float up_avg {0.f};
+			float down_avg {0.f};
+
+			// estimated time left in seconds, negative if unknown
+			float eta {-1.f};
+		};
+
+		// the transfer made no progress for too long and was canceled/paused
+		struct ToxTransferTimedOut {
+			uint64_t ts {0};
+		};
+
 	} // Ephemeral
 
 } // ObjectStore::Components
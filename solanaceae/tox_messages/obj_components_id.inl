@@ -20,6 +20,8 @@ constexpr std::string_view entt::type_name<x>::value() noexcept { \
 
 DEFINE_COMP_ID(ObjComp::Tox::FileID)
 DEFINE_COMP_ID(ObjComp::Tox::FileKind)
+DEFINE_COMP_ID(ObjComp::Tox::ReceivedRanges)
+DEFINE_COMP_ID(ObjComp::Tox::ContentHash)
 
 // tmp
 DEFINE_COMP_ID(ObjComp::Tox::TagIncomming)
@@ -28,6 +30,11 @@ DEFINE_COMP_ID(ObjComp::Tox::TagOutgoing)
 DEFINE_COMP_ID(ObjComp::Ephemeral::ToxTransferFriend)
 DEFINE_COMP_ID(ObjComp::Ephemeral::ToxContact)
 DEFINE_COMP_ID(ObjComp::Ephemeral::ToxMessage)
+DEFINE_COMP_ID(ObjComp::Ephemeral::ToxMemoryFile)
+DEFINE_COMP_ID(ObjComp::Ephemeral::ToxTransferPriority)
+DEFINE_COMP_ID(ObjComp::Ephemeral::ToxTransferQueued)
+DEFINE_COMP_ID(ObjComp::Ephemeral::ToxTransferRate)
+DEFINE_COMP_ID(ObjComp::Ephemeral::ToxTransferTimedOut)
 
 #undef DEFINE_COMP_ID
 
@@ -0,0 +1,71 @@
+#include "./tox_block_cache.hpp"
+
+std::string ToxBlockCache::makeKey(std::string_view file_path, const uint64_t file_size, const int64_t file_mtime, const uint64_t position) {
+	std::string key;
+	key.reserve(file_path.size() + 3*sizeof(uint64_t));
+	key.append(file_path);
+	// a changed file (size or mtime) does not hit old blocks
+	key.append(reinterpret_cast<const char*>(&file_size), sizeof(file_size));
+	key.append(reinterpret_cast<const char*>(&file_mtime), sizeof(file_mtime));
+	key.append(reinterpret_cast<const char*>(&position), sizeof(position));
+	return key;
+}
+
+void ToxBlockCache::evict(const uint64_t max_bytes) {
+	while (_bytes > max_bytes && !_lru.empty()) {
+		auto& entry = _lru.back();
+		_bytes -= entry.data->size();
+		_entries.erase(entry.key);
+		_lru.pop_back();
+		evictions++;
+	}
+}
+
+ToxBlockCache::Block ToxBlockCache::get(std::string_view file_path, const uint64_t file_size, const int64_t file_mtime, const uint64_t position, const uint64_t size) {
+	if (_entries.empty()) {
+		return nullptr;
+	}
+
+	const auto it = _entries.find(makeKey(file_path, file_size, file_mtime, position));
+	if (it == _entries.end() || it->second->data->size() < size) {
+		return nullptr;
+	}
+
+	// mark as used
+	_lru.splice(_lru.begin(), _lru, it->second);
+
+	return it->second->data;
+}
+
+void ToxBlockCache::put(std::string_view file_path, const uint64_t file_size, const int64_t file_mtime, const uint64_t position, Block data) {
+	if (!data || data->empty() || data->size() > _max_bytes) {
+		return;
+	}
+
+	auto key = makeKey(file_path, file_size, file_mtime, position);
+
+	if (const auto it = _entries.find(key); it != _entries.end()) {
+		_bytes -= it->second->data->size();
+		_lru.erase(it->second);
+		_entries.erase(it);
+	}
+
+	const uint64_t size = data->size();
+	evict(_max_bytes - size);
+
+	_lru.push_front(Entry{key, std::move(data)});
+	_entries.emplace(std::move(key), _lru.begin());
+	_bytes += size;
+}
+
+void ToxBlockCache::setMaxBytes(uint64_t max_bytes) {
+	_max_bytes = max_bytes;
+	evict(_max_bytes);
+}
+
+void ToxBlockCache::clear(void) {
+	_entries.clear();
+	_lru.clear();
+	_bytes = 0;
+}
+
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+// read cache shared by outgoing transfers of the same file (fan-out).
+// blocks are keyed by file path, size, modification time and offset.
+// the least recently used ones are dropped once over the byte budget.
+// blocks are immutable and shared with the readers, never copied
+class ToxBlockCache {
+	public:
+		using Block = std::shared_ptr<const std::vector<uint8_t>>;
+
+	private:
+		struct Entry {
+			std::string key;
+			Block data;
+		};
+
+		std::list<Entry> _lru; // front is most recently used
+		std::unordered_map<std::string, std::list<Entry>::iterator> _entries;
+
+		uint64_t _bytes {0};
+		uint64_t _max_bytes {16*1024*1024};
+
+		static std::string makeKey(std::string_view file_path, const uint64_t file_size, const int64_t file_mtime, const uint64_t position);
+
+		void evict(const uint64_t max_bytes);
+
+	public:
+		uint64_t evictions {0};
+
+		// block starting at position with at least size bytes, nullptr if not cached
+		Block get(std::string_view file_path, const uint64_t file_size, const int64_t file_mtime, const uint64_t position, const uint64_t size);
+
+		// replaces an existing block at position
+		void put(std::string_view file_path, const uint64_t file_size, const int64_t file_mtime, const uint64_t position, Block data);
+
+		// 0 disables the cache
+		void setMaxBytes(uint64_t max_bytes);
+		uint64_t bytes(void) const { return _bytes; }
+
+		void clear(void);
+};
+
@@ -1,7 +1,5 @@
 #include "./tox_message_manager.hpp"
 
-#include <solanaceae/util/time.hpp>
-
 #include <solanaceae/toxcore/tox_interface.hpp>
 #include <solanaceae/contact/contact_store_i.hpp>
 
@@ -10,9 +8,9 @@
 #include <solanaceae/message3/components.hpp>
 #include "./msg_components.hpp"
 
-#include <sodium.h>
+#include <solanaceae/tox_util/log.hpp>
 
-#include <iostream>
+#include <sodium.h>
 
 ToxMessageManager::ToxMessageManager(
 	RegistryMessageModelI& rmm,
@@ -83,13 +81,14 @@ bool ToxMessageManager::sendText(const Contact4 c, std::string_view message, boo
 	Message3Registry& reg = *reg_ptr;
 
 	if (!cr.all_of<Contact::Components::Self>(c)) {
-		std::cerr << "TMM error: cant get self\n";
+		TOX_LOG_ERROR("TMM") << "cant get self";
 		return false;
 	}
 	const Contact4 c_self = cr.get<Contact::Components::Self>(c).self;
 
 	// get current time unix epoch utc
-	uint64_t ts = getTimeMS();
+	// not part of an event batch
+	uint64_t ts = _tcm.tickClock().nowPrecise();
 
 	// TODO: split into multiple messages here, if its too long ?
 
@@ -128,7 +127,7 @@ bool ToxMessageManager::sendText(const Contact4 c, std::string_view message, boo
 			const uint32_t msg_id = randombytes_random();
 			reg.emplace<Message::Components::ToxFriendMessageID>(new_msg_e, msg_id);
 
-			std::cerr << "TMM: failed to send friend message\n";
+			TOX_LOG_WARNING("TMM") << "failed to send friend message";
 		} else {
 			reg.emplace<Message::Components::ToxFriendMessageID>(new_msg_e, res.value());
 		}
@@ -137,7 +136,7 @@ bool ToxMessageManager::sendText(const Contact4 c, std::string_view message, boo
 		// set manually, so it can still be synced
 		const uint32_t msg_id = randombytes_random();
 		reg.emplace<Message::Components::ToxFriendMessageID>(new_msg_e, msg_id);
-		std::cerr << "TMM: failed to send friend message, offline and not in tox profile\n";
+		TOX_LOG_WARNING("TMM") << "failed to send friend message, offline and not in tox profile";
 	} else if (
 		cr.any_of<Contact::Components::ToxGroupEphemeral>(c)
 	) {
@@ -154,7 +153,7 @@ bool ToxMessageManager::sendText(const Contact4 c, std::string_view message, boo
 			const uint32_t msg_id = randombytes_random();
 			reg.emplace<Message::Components::ToxGroupMessageID>(new_msg_e, msg_id);
 
-			std::cerr << "TMM: failed to send group message!\n";
+			TOX_LOG_WARNING("TMM") << "failed to send group message!";
 		} else {
 			// TODO: does group msg without msgid make sense???
 			reg.emplace<Message::Components::ToxGroupMessageID>(new_msg_e, message_id_opt.value());
@@ -189,7 +188,7 @@ bool ToxMessageManager::sendText(const Contact4 c, std::string_view message, boo
 			const uint32_t msg_id = randombytes_random();
 			reg.emplace<Message::Components::ToxGroupMessageID>(new_msg_e, msg_id);
 
-			std::cerr << "TMM: failed to send group message!\n";
+			TOX_LOG_WARNING("TMM") << "failed to send group message!";
 		} else {
 			// TODO: does group msg without msgid make sense???
 			reg.emplace<Message::Components::ToxGroupMessageID>(new_msg_e, message_id_opt.value());
@@ -209,21 +208,22 @@ bool ToxMessageManager::onToxEvent(const Tox_Event_Friend_Message* e) {
 	Tox_Message_Type type = tox_event_friend_message_get_type(e);
 
 	// get current time unix epoch utc
-	uint64_t ts = getTimeMS();
+	uint64_t ts = _tcm.tickClock().now();
 
 	std::string_view message {reinterpret_cast<const char*>(tox_event_friend_message_get_message(e)), tox_event_friend_message_get_message_length(e)};
 	message = message.substr(0, message.find_first_of('\0')); // trim \0 // hi zoff
 	// TODO: low-p, extract ts from zofftrim
 	// TODO: sanitize utf8
 
-	std::cout << "TMM friend message " << message << "\n";
+	// no content in the logs
+	TOX_LOG_DEBUG("TMM") << "friend message frd:" << friend_number << " len:" << message.size();
 
 	const auto c = _tcm.getContactFriend(friend_number);
 	const auto self_c = c.get<Contact::Components::Self>().self;
 
 	auto* reg_ptr = _rmm.get(c);
 	if (reg_ptr == nullptr) {
-		std::cerr << "TMM error: cant find reg\n";
+		TOX_LOG_ERROR("TMM") << "cant find reg";
 		return false;
 	}
 
@@ -261,14 +261,14 @@ bool ToxMessageManager::onToxEvent(const Tox_Event_Friend_Read_Receipt* e) {
 	uint32_t msg_id = tox_event_friend_read_receipt_get_message_id(e);
 
 	// get current time unix epoch utc
-	uint64_t ts = getTimeMS();
+	uint64_t ts = _tcm.tickClock().now();
 
 	const auto c = _tcm.getContactFriend(friend_number);
 	const auto self_c = c.get<Contact::Components::Self>().self;
 
 	auto* reg_ptr = _rmm.get(c);
 	if (reg_ptr == nullptr) {
-		std::cerr << "TMM error: cant find reg\n";
+		TOX_LOG_ERROR("TMM") << "cant find reg";
 		return false;
 	}
 
@@ -296,10 +296,10 @@ bool ToxMessageManager::onToxEvent(const Tox_Event_Group_Message* e) {
 	const uint32_t message_id = tox_event_group_message_get_message_id(e);
 	const Tox_Message_Type type = tox_event_group_message_get_message_type(e);
 
-	const uint64_t ts = getTimeMS();
+	const uint64_t ts = _tcm.tickClock().now();
 
 	auto message = std::string_view{reinterpret_cast<const char*>(tox_event_group_message_get_message(e)), tox_event_group_message_get_message_length(e)};
-	std::cout << "TMM group message: " << message << "\n";
+	TOX_LOG_DEBUG("TMM") << "group message grp:" << group_number << " peer:" << peer_number << " len:" << message.size();
 
 	const auto c = _tcm.getContactGroupPeer(group_number, peer_number);
 	const auto self_c = c.get<Contact::Components::Self>().self;
@@ -307,7 +307,7 @@ bool ToxMessageManager::onToxEvent(const Tox_Event_Group_Message* e) {
 	auto* reg_ptr = _rmm.get(c);
 	//auto* reg_ptr = _rmm.get({ContactGroupPeerEphemeral{group_number, peer_number}});
 	if (reg_ptr == nullptr) {
-		std::cerr << "TMM error: cant find reg\n";
+		TOX_LOG_ERROR("TMM") << "cant find reg";
 		return false;
 	}
 
@@ -357,17 +357,17 @@ bool ToxMessageManager::onToxEvent(const Tox_Event_Group_Private_Message* e) {
 	const uint32_t peer_number = tox_event_group_private_message_get_peer_id(e);
 	const Tox_Message_Type type = tox_event_group_private_message_get_message_type(e);
 
-	const uint64_t ts = getTimeMS();
+	const uint64_t ts = _tcm.tickClock().now();
 
 	auto message = std::string_view{reinterpret_cast<const char*>(tox_event_group_private_message_get_message(e)), tox_event_group_private_message_get_message_length(e)};
-	std::cout << "TMM group private message: " << message << "\n";
+	TOX_LOG_DEBUG("TMM") << "group private message grp:" << group_number << " peer:" << peer_number << " len:" << message.size();
 
 	const auto c = _tcm.getContactGroupPeer(group_number, peer_number);
 	const auto self_c = c.get<Contact::Components::Self>().self;
 
 	auto* reg_ptr = _rmm.get(c);
 	if (reg_ptr == nullptr) {
-		std::cerr << "TMM error: cant find reg\n";
+		TOX_LOG_ERROR("TMM") << "cant find reg";
 		return false;
 	}
 
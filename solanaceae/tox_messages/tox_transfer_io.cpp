@@ -0,0 +1,140 @@
+#include "./tox_transfer_io.hpp"
+
+#include <chrono>
+#include <functional>
+#include <variant>
+
+std::vector<uint8_t> ToxTransferIO::takeReadResult(ByteSpanWithOwnership&& res) {
+	if (auto* owned = std::get_if<std::vector<uint8_t>>(&res.data); owned != nullptr) {
+		return std::move(*owned);
+	}
+
+	const ByteSpan res_span = res;
+	return std::vector<uint8_t>(res_span.ptr, res_span.ptr+res_span.size);
+}
+
+ToxTransferIO::ToxTransferIO(size_t thread_count) : _thread_count(thread_count == 0 ? 1 : thread_count) {
+}
+
+ToxTransferIO::~ToxTransferIO(void) {
+	if (_workers.empty()) {
+		return; // never used
+	}
+
+	// completions are discarded, make sure workers dont wait for space
+	const auto drain = [this]() {
+		Job job;
+		for (auto& w : _workers) {
+			while (w->completion_queue.pop(job)) {
+				job = {};
+			}
+		}
+	};
+
+	// all submitted jobs have to reach a worker before quitting
+	for (;;) {
+		flushBacklog();
+
+		bool backlog_empty {true};
+		for (const auto& w : _workers) {
+			backlog_empty = backlog_empty && w->backlog.empty();
+		}
+		if (backlog_empty) {
+			break;
+		}
+
+		drain();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	_quit.store(true, std::memory_order_release);
+	for (auto& w : _workers) {
+		{ std::lock_guard lock{w->wake_mutex}; }
+		w->wake_cv.notify_all();
+	}
+
+	for (auto& w : _workers) {
+		while (!w->done.load(std::memory_order_acquire)) {
+			drain();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		w->thread.join();
+	}
+}
+
+void ToxTransferIO::start(void) {
+	for (size_t i = 0; i < _thread_count; i++) {
+		auto& w = _workers.emplace_back(std::make_unique<Worker>());
+		w->thread = std::thread([this, w_ptr = w.get()]() { workerRun(*w_ptr); });
+	}
+}
+
+void ToxTransferIO::workerRun(Worker& w) {
+	Job job;
+	for (;;) {
+		if (!w.submit_queue.pop(job)) {
+			if (_quit.load(std::memory_order_acquire)) {
+				break; // all submitted jobs done
+			}
+
+			std::unique_lock lock{w.wake_mutex};
+			w.wake_cv.wait_for(lock, std::chrono::milliseconds(100), [&]() {
+				return !w.submit_queue.empty() || _quit.load(std::memory_order_acquire);
+			});
+			continue;
+		}
+
+		if (job.type == Job::Type::write) {
+			job.success = job.file->write(ByteSpan{job.data}, job.position);
+		} else {
+			job.data = takeReadResult(job.file->read(job.size, job.position));
+			job.success = !job.data.empty();
+		}
+
+		// dont hold on to the file longer than needed
+		job.file.reset();
+
+		// waits for the event loop to poll()
+		while (!w.completion_queue.push(std::move(job))) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		job = {};
+	}
+
+	w.done.store(true, std::memory_order_release);
+}
+
+void ToxTransferIO::flushBacklog(void) {
+	for (auto& w : _workers) {
+		if (w->backlog.empty()) {
+			continue;
+		}
+
+		while (!w->backlog.empty() && w->submit_queue.push(std::move(w->backlog.front()))) {
+			w->backlog.pop_front();
+		}
+
+		{ std::lock_guard lock{w->wake_mutex}; }
+		w->wake_cv.notify_one();
+	}
+}
+
+void ToxTransferIO::submit(Job&& job) {
+	if (_workers.empty()) {
+		start();
+	}
+
+	Worker& w = *_workers[std::hash<File2I*>{}(job.file.get()) % _workers.size()];
+
+	_in_flight++;
+
+	// behind older jobs, a file's jobs stay in order
+	if (!w.backlog.empty() || !w.submit_queue.push(std::move(job))) {
+		w.backlog.push_back(std::move(job));
+		return;
+	}
+
+	// make sure the worker is either waiting or will see the job
+	{ std::lock_guard lock{w.wake_mutex}; }
+	w.wake_cv.notify_one();
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <solanaceae/object_store/object_store.hpp>
+#include <solanaceae/file/file2.hpp>
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <array>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cstdint>
+
+// background file io for the ToxTransferManager.
+// jobs are sharded by file, so a File2I is only ever used by one worker.
+// submission and completion queues are lock-free spsc rings,
+// completions are collected on the event loop thread with poll().
+// workers are started with the first job.
+class ToxTransferIO {
+	public:
+		struct Job {
+			enum class Type : uint8_t {
+				read,
+				write,
+			} type {Type::read};
+
+			Object o {entt::null};
+			std::shared_ptr<File2I> file;
+			uint64_t position {0};
+			uint64_t size {0}; // read only
+			std::vector<uint8_t> data; // write payload, or read result
+
+			bool success {false};
+		};
+
+	private:
+		template<typename T, size_t N>
+		class SPSCRing {
+			std::array<T, N> _slots;
+			alignas(64) std::atomic<size_t> _head {0}; // consumer
+			alignas(64) std::atomic<size_t> _tail {0}; // producer
+
+			public:
+				bool push(T&& v) {
+					const size_t tail = _tail.load(std::memory_order_relaxed);
+					if (tail - _head.load(std::memory_order_acquire) == N) {
+						return false; // full
+					}
+					_slots[tail % N] = std::move(v);
+					_tail.store(tail+1, std::memory_order_release);
+					return true;
+				}
+
+				bool pop(T& v) {
+					const size_t head = _head.load(std::memory_order_relaxed);
+					if (head == _tail.load(std::memory_order_acquire)) {
+						return false; // empty
+					}
+					v = std::move(_slots[head % N]);
+					_head.store(head+1, std::memory_order_release);
+					return true;
+				}
+
+				// consumer only
+				bool empty(void) const {
+					return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+				}
+		};
+
+		struct Worker {
+			SPSCRing<Job, 64> submit_queue;
+			SPSCRing<Job, 128> completion_queue;
+
+			// only for sleeping, the queues dont lock
+			std::mutex wake_mutex;
+			std::condition_variable wake_cv;
+
+			std::thread thread;
+			std::atomic<bool> done {false};
+
+			// event loop thread only, jobs that did not fit into submit_queue yet
+			std::deque<Job> backlog;
+		};
+
+		size_t _thread_count {1};
+		std::vector<std::unique_ptr<Worker>> _workers;
+		std::atomic<bool> _quit {false};
+
+		uint64_t _in_flight {0};
+
+		void start(void);
+		void workerRun(Worker& w);
+
+		// moves backlog jobs into the submit queues, as far as they fit
+		void flushBacklog(void);
+
+	public:
+		explicit ToxTransferIO(size_t thread_count = 1);
+		~ToxTransferIO(void); // finishes all submitted jobs
+
+		// never blocks, jobs that dont fit are kept in order until poll()
+		void submit(Job&& job);
+
+		// calls fn(Job&) for every completed job, on the calling thread
+		// fn may submit new jobs
+		template<typename FN>
+		void poll(FN&& fn) {
+			flushBacklog();
+
+			Job job;
+			for (auto& w : _workers) {
+				while (w->completion_queue.pop(job)) {
+					_in_flight--;
+					fn(job);
+					job = {};
+				}
+			}
+		}
+
+		uint64_t inFlight(void) const { return _in_flight; }
+
+		// the bytes of a File2I::read(), moved out if the result owns them.
+		// only non owning results (eg mmap) are copied
+		static std::vector<uint8_t> takeReadResult(ByteSpanWithOwnership&& res);
+};
+
@@ -1,7 +1,5 @@
 #include "./tox_transfer_manager.hpp"
 
-#include <solanaceae/util/time.hpp>
-
 #include <solanaceae/toxcore/tox_interface.hpp>
 #include <solanaceae/contact/contact_store_i.hpp>
 
@@ -11,12 +9,17 @@
 #include <solanaceae/tox_contacts/components.hpp>
 #include <solanaceae/message3/components.hpp>
 #include "./obj_components.hpp"
+#include "./backends/file2_mmap.hpp"
+#include "./backends/file2_mem.hpp"
+
+#include <solanaceae/tox_util/log.hpp>
 
 #include <sodium.h>
 
 #include <filesystem>
+#include <algorithm>
+#include <chrono>
 #include <cassert>
-#include <iostream>
 
 // https://youtu.be/4XsL5iYHS6c
 
@@ -25,14 +28,168 @@ namespace Components {
 	struct TFTFile2 {
 		// the cached file2 for receiving/sending only
 		// should be destroyed when no activity and recreated on demand
-		std::unique_ptr<File2I> file;
+		// shared with in flight io jobs
+		std::shared_ptr<File2I> file;
 
 		// set to current time on init, read, write
 		uint64_t last_activity_ts {};
+
+		// can be closed and opened again via the object backend
+		bool reopenable {false};
+
+		// the whole file, if memory mapped (File2MMapR). lives as long as file
+		ByteSpan mapped {};
+		bool mapped_checked {false};
+	};
+
+	// file2 closed while idle, opened again on demand
+	struct TFTFileClosed {};
+
+	// sending only, chunk requests are served from here.
+	// the blocks are shared with the read cache (read only)
+	struct TFTReadAhead {
+		ToxBlockCache::Block buffer;
+		uint64_t position {0}; // file offset of buffer[0]
+
+		// async io only, filled in the background
+		ToxBlockCache::Block next;
+		uint64_t next_position {0};
+		bool read_pending {false};
+		// chunk requests waiting for the pending read (position, size)
+		std::vector<std::pair<uint64_t, uint64_t>> parked;
+
+		// version of the file in the read cache, -1 if unknown (not cached)
+		int64_t file_mtime {-1};
+
+		uint64_t hits {0};
+		uint64_t misses {0};
+	};
+
+	// receiving only, contiguous chunks are collected and written in one go
+	struct TFTWriteBehind {
+		std::vector<uint8_t> buffer;
+		uint64_t position {0}; // file offset of buffer[0]
+	};
+
+	// async io jobs in flight for this object, outlives the transfer.
+	// while present, the file2 is in use by a worker and must not be touched
+	struct TFTIOPending {
+		uint32_t reads {0};
+		uint32_t writes {0};
+		bool write_failed {false};
+	};
+
+	// received everything, but writes are still in flight
+	struct TFTFinishPending {
+		uint32_t friend_number {0};
+	};
+
+	// memory avatar accepted to SingleInfoLocal, written there once complete
+	struct TFTAvatarSave {};
+
+	// small incoming file received into ToxFTMemory, written to
+	// SingleInfoLocal (ToxFTFilesystem) once it ends or grows too big
+	struct TFTMemoryRecv {};
+
+	// sending only, chunks toxcore did not take yet (sendq full).
+	// they have to go out in order, later chunks queue up behind them
+	struct TFTSendRetry {
+		struct Chunk {
+			uint64_t position {0};
+			std::vector<uint8_t> data;
+		};
+		std::deque<Chunk> chunks;
+		uint64_t next_try_ts {0};
+		uint32_t attempts {0};
+	};
+
+	// running content hash, valid only while data came in order
+	struct TFTHashState {
+		crypto_generichash_state state;
+		uint64_t next_position {0};
+		bool valid {true};
+	};
+
+	// sending only, data of a stream (unknown size), written by the producer
+	struct TFTStreamBuffer {
+		std::vector<uint8_t> buffer;
+		uint64_t consumed {0}; // sent bytes at the front of buffer
+		uint64_t position {0}; // stream offset of buffer[consumed]
+		bool ended {false};
+		// chunk requests waiting for data (position, size), in request order.
+		// while not empty, newer requests queue up behind them
+		std::vector<std::pair<uint64_t, uint64_t>> waiting;
+
+		uint64_t available(void) const { return buffer.size() - consumed; }
+	};
+
+	// paused by the scheduler, not the user
+	struct TFTSchedPaused {};
+
+	// TagTransferPaused is the union of these and the scheduler pause.
+	// paused by the user (pause()) or the stall handler
+	struct TFTLocalPaused {};
+	// paused by the friend
+	struct TFTRemotePaused {};
+
+	// last progress update thrown for the transfer
+	struct TFTProgress {
+		uint64_t last_event_ts {0};
+	};
+
+	// TransferStats changed since the last update
+	struct TFTProgressDirty {};
+
+	// TransferStats at the start of the current rate window
+	struct TFTRateWindow {
+		uint64_t total_up {0};
+		uint64_t total_down {0};
+		uint64_t ts {0};
+	};
+
+	// last chunk/control activity, for stall detection
+	struct TFTActivity {
+		uint64_t ts {0};
+		bool in_wheel {false};
 	};
 
 } // Components
 
+static uint64_t blockSize(const ToxBlockCache::Block& block) {
+	return block ? block->size() : 0;
+}
+
+// modification time of the file, -1 if unknown
+static int64_t fileMTime(ObjectHandle o) {
+	const auto* sil = o.try_get<ObjComp::F::SingleInfoLocal>();
+	if (sil == nullptr || sil->file_path.empty()) {
+		return -1;
+	}
+
+	std::error_code ec;
+	const auto mtime = std::filesystem::last_write_time(std::filesystem::u8path(sil->file_path), ec);
+	if (ec) {
+		return -1;
+	}
+
+	return int64_t(mtime.time_since_epoch().count());
+}
+
+// aligned block(s) containing the chunk, clamped to the file size
+static std::pair<uint64_t, uint64_t> readAheadBlock(const uint64_t read_ahead_size, const uint64_t position, const uint64_t size, const uint64_t file_size) {
+	const uint64_t block_size = std::max<uint64_t>(read_ahead_size, size);
+	const uint64_t block_pos = position - position % block_size;
+	uint64_t read_size = block_size;
+	if (position+size > block_pos+block_size) {
+		read_size += block_size; // straddles
+	}
+	if (file_size > block_pos) {
+		read_size = std::min<uint64_t>(read_size, file_size - block_pos);
+	}
+
+	return {block_pos, read_size};
+}
+
 void ToxTransferManager::toxFriendLookupAdd(ObjectHandle o) {
 	const auto& comp = o.get<ObjComp::Ephemeral::ToxTransferFriend>();
 	const uint64_t key {(uint64_t(comp.friend_number) << 32) | comp.transfer_number};
@@ -46,6 +203,10 @@ void ToxTransferManager::toxFriendLookupAdd(ObjectHandle o) {
 		assert(!_friend_receiving_lookup.count(key));
 		_friend_receiving_lookup[key] = o;
 	}
+
+	_friend_transfers[comp.friend_number].push_back(o.entity());
+
+	objTouchActivity(o);
 }
 
 void ToxTransferManager::toxFriendLookupRemove(ObjectHandle o) {
@@ -61,6 +222,19 @@ void ToxTransferManager::toxFriendLookupRemove(ObjectHandle o) {
 		assert(_friend_receiving_lookup.count(key));
 		_friend_receiving_lookup.erase(key);
 	}
+
+	if (auto it = _friend_transfers.find(comp.friend_number); it != _friend_transfers.end()) {
+		auto& list = it->second;
+		const auto list_it = std::find(list.begin(), list.end(), o.entity());
+		if (list_it != list.end()) {
+			// order does not matter
+			*list_it = list.back();
+			list.pop_back();
+		}
+		if (list.empty()) {
+			_friend_transfers.erase(it);
+		}
+	}
 }
 
 ObjectHandle ToxTransferManager::toxFriendLookupSending(const uint32_t friend_number, const uint32_t file_number) const {
@@ -81,62 +255,559 @@ ObjectHandle ToxTransferManager::toxFriendLookupReceiving(const uint32_t friend_
 	}
 }
 
+void ToxTransferManager::toxTransferCleanup(ObjectHandle o) {
+	toxFriendLookupRemove(o);
+
+	// complete or not, the data goes to disk now (resume continues from there).
+	// on failure it stays in memory
+	if (o.all_of<Components::TFTMemoryRecv>() && !objSpillMemoryRecv(o)) {
+		TOX_LOG_ERROR("TTM") << "failed writing memory received e:" << entt::to_integral(o.entity()) << " to disk";
+	}
+
+	o.remove<
+		ObjComp::Ephemeral::ToxTransferFriend,
+		Components::TFTFile2,
+		Components::TFTFileClosed,
+		Components::TFTReadAhead,
+		Components::TFTWriteBehind,
+		// the caller throws the final update
+		Components::TFTProgressDirty,
+		Components::TFTSchedPaused,
+		Components::TFTLocalPaused,
+		Components::TFTRemotePaused,
+		Components::TFTSendRetry,
+		Components::TFTHashState,
+		Components::TFTStreamBuffer
+	>();
+}
+
+bool ToxTransferManager::objFlushWriteBehind(ObjectHandle o) {
+	auto* wb_ptr = o.try_get<Components::TFTWriteBehind>();
+	if (wb_ptr == nullptr || wb_ptr->buffer.empty()) {
+		return true;
+	}
+
+	auto* file_ptr = objGetFile2Write(o);
+	if (file_ptr == nullptr) {
+		return false;
+	}
+
+	_stats.write_behind_writes++;
+
+	// no point in a worker for memory
+	if (_io && !o.all_of<ObjComp::Ephemeral::ToxMemoryFile>()) {
+		ToxTransferIO::Job job;
+		job.type = ToxTransferIO::Job::Type::write;
+		job.o = o.entity();
+		job.file = o.get<Components::TFTFile2>().file;
+		job.position = wb_ptr->position;
+		job.data = std::move(wb_ptr->buffer);
+
+		wb_ptr->buffer.clear();
+		if (!_write_buffer_pool.empty()) {
+			wb_ptr->buffer = std::move(_write_buffer_pool.back());
+			_write_buffer_pool.pop_back();
+		}
+
+		o.get_or_emplace<Components::TFTIOPending>().writes++;
+		_stats.io_async_writes++;
+
+		_io->submit(std::move(job));
+
+		// errors are reported on completion
+		return true;
+	}
+
+	const bool res = file_ptr->write(ByteSpan{wb_ptr->buffer}, wb_ptr->position);
+	if (res) {
+		objAddReceivedRange(o, wb_ptr->position, wb_ptr->buffer.size());
+	}
+
+	// keeps capacity
+	wb_ptr->buffer.clear();
+
+	return res;
+}
+
+void ToxTransferManager::objAddReceivedRange(ObjectHandle o, const uint64_t position, const uint64_t size) {
+	if (size == 0) {
+		return;
+	}
+
+	if (!o.all_of<ObjComp::Tox::ReceivedRanges>()) {
+		o.emplace<ObjComp::Tox::ReceivedRanges>();
+		objIndexResumable(o);
+	}
+	auto& ranges = o.get<ObjComp::Tox::ReceivedRanges>().ranges;
+
+	// mostly appends to the last range
+	if (!ranges.empty() && ranges.back().first <= position && ranges.back().second >= position) {
+		ranges.back().second = std::max(ranges.back().second, position+size);
+		return;
+	}
+
+	auto it = std::lower_bound(ranges.begin(), ranges.end(), std::make_pair(position, position+size));
+	it = ranges.insert(it, {position, position+size});
+
+	// merge with the previous one
+	if (it != ranges.begin() && std::prev(it)->second >= it->first) {
+		std::prev(it)->second = std::max(std::prev(it)->second, it->second);
+		it = std::prev(ranges.erase(it));
+	}
+
+	// and the following ones
+	while (std::next(it) != ranges.end() && it->second >= std::next(it)->first) {
+		it->second = std::max(it->second, std::next(it)->second);
+		ranges.erase(std::next(it));
+	}
+}
+
+void ToxTransferManager::objIndexResumable(ObjectHandle o) {
+	if (
+		!o.all_of<ObjComp::Tox::ReceivedRanges, ObjComp::Tox::FileID, ObjComp::Tox::TagIncomming>() ||
+		o.all_of<ObjComp::F::TagLocalHaveAll>()
+	) {
+		return;
+	}
+
+	auto& list = _resumable_index[o.get<ObjComp::Tox::FileID>().id.data];
+	if (std::find(list.cbegin(), list.cend(), o.entity()) == list.cend()) {
+		list.push_back(o.entity());
+	}
+}
+
+bool ToxTransferManager::objOpenRecvFile(ObjectHandle o, std::string_view file_path, const uint64_t file_size) {
+	if (o.all_of<Components::TFTMemoryRecv>()) {
+		// new path, start over
+		o.get_or_emplace<ObjComp::Ephemeral::BackendFile2>().ptr = &_ftb;
+		o.remove<Components::TFTMemoryRecv, ObjComp::Ephemeral::ToxMemoryFile>();
+	}
+
+	if (!objRecvIntoMemory(o, file_size)) {
+		// preallocating already truncated the file
+		bool preallocated {false};
+		if (file_size != UINT64_MAX && file_size >= _preallocate_min_size && Backends::ToxFTFilesystem::preallocate(file_path, file_size)) {
+			preallocated = true;
+			_stats.files_preallocated++;
+		}
+
+		// huh? we also set file2i ?
+		// -1 for unknown (streaming)
+		auto file_impl = std::make_unique<File2RWFile>(file_path, file_size == UINT64_MAX ? -1 : int64_t(file_size), !preallocated);
+		if (!file_impl->isGood()) {
+			TOX_LOG_ERROR("TTM") << "failed opening file '" << file_path << "'!";
+			return false;
+		}
+
+		o.emplace_or_replace<Components::TFTFile2>(std::move(file_impl)).reopenable = o.all_of<ObjComp::Ephemeral::BackendFile2>();
+	}
+
+	o.remove<Components::TFTFileClosed>();
+	// truncated, empty ranges mark it incomplete in the meta until every byte is written
+	o.emplace_or_replace<ObjComp::Tox::ReceivedRanges>();
+	objIndexResumable(o);
+
+	return true;
+}
+
+bool ToxTransferManager::objRecvIntoMemory(ObjectHandle o, const uint64_t file_size) {
+	if (_memory_recv_max_size == 0 || (file_size != UINT64_MAX && file_size > _memory_recv_max_size)) {
+		return false;
+	}
+
+	// only regular files, avatars have their own path
+	if (const auto* kind = o.try_get<ObjComp::Tox::FileKind>(); kind == nullptr || kind->kind != TOX_FILE_KIND_DATA) {
+		return false;
+	}
+
+	// the spill goes through ToxFTFilesystem
+	auto* backend_ptr = o.try_get<ObjComp::Ephemeral::BackendFile2>();
+	if (backend_ptr == nullptr || backend_ptr->ptr != &_ftb) {
+		return false;
+	}
+
+	auto data = std::make_shared<std::vector<uint8_t>>();
+	data->reserve(file_size != UINT64_MAX ? file_size : _memory_recv_max_size);
+
+	// readers get the partial file from memory
+	backend_ptr->ptr = &_ftm;
+	o.emplace_or_replace<Components::TFTMemoryRecv>();
+	o.emplace_or_replace<ObjComp::Ephemeral::ToxMemoryFile>(data);
+	o.emplace_or_replace<Components::TFTFile2>(std::make_shared<File2MemRW>(data)).reopenable = true;
+
+	_stats.memory_recvs++;
+
+	return true;
+}
+
+bool ToxTransferManager::objSpillMemoryRecv(ObjectHandle o) {
+	if (!o.all_of<Components::TFTMemoryRecv>()) {
+		return true;
+	}
+
+	const auto* sil = o.try_get<ObjComp::F::SingleInfoLocal>();
+	const auto* mem_ptr = o.try_get<ObjComp::Ephemeral::ToxMemoryFile>();
+	if (sil == nullptr || sil->file_path.empty() || mem_ptr == nullptr || !mem_ptr->data) {
+		return false;
+	}
+
+	uint64_t file_size {UINT64_MAX};
+	if (const auto* si = o.try_get<ObjComp::F::SingleInfo>(); si != nullptr) {
+		file_size = si->file_size;
+	}
+
+	// nothing is on disk yet, small enough for one write.
+	// holes are zero in memory too, ReceivedRanges stays correct
+	auto file_impl = std::make_shared<File2RWFile>(sil->file_path, file_size == UINT64_MAX ? -1 : int64_t(file_size), true);
+	if (!file_impl->isGood() || (!mem_ptr->data->empty() && !file_impl->write(ByteSpan{*mem_ptr->data}, 0))) {
+		// the memory copy stays
+		return false;
+	}
+
+	// only now, a failed write keeps serving from memory
+	o.get_or_emplace<ObjComp::Ephemeral::BackendFile2>().ptr = &_ftb;
+	o.remove<Components::TFTMemoryRecv, ObjComp::Ephemeral::ToxMemoryFile>();
+
+	if (o.all_of<ObjComp::Ephemeral::ToxTransferFriend>()) {
+		// still receiving, the rest goes to the file
+		o.emplace_or_replace<Components::TFTFile2>(std::move(file_impl)).reopenable = true;
+	} else {
+		o.remove<Components::TFTFile2>();
+	}
+
+	TOX_LOG_DEBUG("TTM") << "wrote memory received e:" << entt::to_integral(o.entity()) << " to disk";
+
+	return true;
+}
+
+ObjectHandle ToxTransferManager::findResumableRecv(const Contact4 c, const std::vector<uint8_t>& file_id, const uint64_t file_size) {
+	std::array<uint8_t, 32> id {};
+	if (file_id.size() != id.size()) {
+		return {};
+	}
+	std::copy(file_id.cbegin(), file_id.cend(), id.begin());
+
+	const auto it = _resumable_index.find(id);
+	if (it == _resumable_index.end()) {
+		return {};
+	}
+
+	auto& reg = _os.registry();
+	auto& list = it->second;
+
+	ObjectHandle res;
+	for (size_t i = 0; i < list.size();) {
+		const Object ov = list[i];
+
+		// drop the ones that stopped being partial
+		if (
+			!reg.valid(ov) ||
+			!reg.all_of<ObjComp::Tox::ReceivedRanges, ObjComp::Tox::FileID>(ov) ||
+			reg.all_of<ObjComp::F::TagLocalHaveAll>(ov) ||
+			reg.get<ObjComp::Tox::FileID>(ov).id.data != id
+		) {
+			list[i] = list.back();
+			list.pop_back();
+			continue;
+		}
+		i++;
+
+		if (static_cast<bool>(res)) {
+			continue; // only pruning
+		}
+
+		// not active, was accepted and can be reopened
+		if (
+			reg.any_of<ObjComp::Ephemeral::ToxTransferFriend, Components::TFTIOPending>(ov) ||
+			!reg.all_of<ObjComp::Ephemeral::BackendFile2, ObjComp::Ephemeral::ToxContact, ObjComp::F::SingleInfo>(ov)
+		) {
+			continue;
+		}
+
+		if (reg.get<ObjComp::Ephemeral::ToxContact>(ov).c.entity() != c || reg.get<ObjComp::F::SingleInfo>(ov).file_size != file_size) {
+			continue;
+		}
+
+		res = {reg, ov};
+	}
+
+	if (list.empty()) {
+		_resumable_index.erase(it);
+	}
+
+	return res;
+}
+
+bool ToxTransferManager::resumeRecv(ObjectHandle o, const uint32_t friend_number, const uint32_t file_number) {
+	const auto& ranges = o.get<ObjComp::Tox::ReceivedRanges>().ranges;
+
+	uint64_t offset {0};
+	if (!ranges.empty() && ranges.front().first == 0) {
+		offset = ranges.front().second;
+	}
+
+	o.emplace_or_replace<ObjComp::Ephemeral::ToxTransferFriend>(friend_number, file_number);
+	o.emplace_or_replace<ObjComp::Ephemeral::File::TagTransferPaused>();
+	o.remove<ObjComp::Ephemeral::ToxTransferTimedOut>();
+
+	if (offset != 0) {
+		// has to happen before the transfer is accepted
+		const auto err = _t.toxFileSeek(friend_number, file_number, offset);
+		if (err != TOX_ERR_FILE_SEEK_OK) {
+			TOX_LOG_WARNING("TTM") << "seeking resumed transfer frd:" << friend_number << " fnb:" << file_number << " failed " << err << ", receiving all again";
+			offset = 0;
+		}
+	}
+
+	o.get_or_emplace<ObjComp::Ephemeral::File::TransferStats>().total_down = offset;
+
+	toxFriendLookupAdd(o);
+
+	TOX_LOG_INFO("TTM") << "resuming e:" << entt::to_integral(o.entity()) << " frd:" << friend_number << " fnb:" << file_number << " at " << offset;
+
+	_os.throwEventUpdate(o);
+
+	// was accepted before
+	return acceptObj(o);
+}
+
 File2I* ToxTransferManager::objGetFile2Write(ObjectHandle o) {
 	auto* file2_comp_ptr = o.try_get<Components::TFTFile2>();
-	if (file2_comp_ptr == nullptr || !file2_comp_ptr->file || !file2_comp_ptr->file->can_write || !file2_comp_ptr->file->isGood()) {
-		std::cout << "TTM: (re)opening object " << entt::to_integral(entt::to_entity(o.entity())) << " for writing\n";
+	if (
+		file2_comp_ptr == nullptr ||
+		!file2_comp_ptr->file ||
+		!file2_comp_ptr->file->can_write ||
+		// cant ask the file while a worker uses it
+		(!o.all_of<Components::TFTIOPending>() && !file2_comp_ptr->file->isGood())
+	) {
+		TOX_LOG_DEBUG("TTM") << "(re)opening object " << entt::to_integral(entt::to_entity(o.entity())) << " for writing";
 		// (re)request file2 from backend
 		auto* file_backend = o.get<ObjComp::Ephemeral::BackendFile2>().ptr;
 		if (file_backend == nullptr) {
-			std::cerr << "TTM error: object backend nullptr\n";
+			TOX_LOG_ERROR("TTM") << "object backend nullptr";
 			return nullptr;
 		}
 
 		//auto new_file = _mfb.file2(o, StorageBackendIFile2::FILE2_WRITE);
 		auto file2 = file_backend->file2(o, StorageBackendIFile2::FILE2_WRITE);
 		if (!file2 || !file2->isGood() || !file2->can_write) {
-			std::cerr << "TTM error: creating file2 from object via backendI\n";
+			TOX_LOG_ERROR("TTM") << "creating file2 from object via backendI";
 			return nullptr;
 		}
 
-		file2_comp_ptr = &o.emplace_or_replace<Components::TFTFile2>(std::move(file2), getTimeMS());
+		file2_comp_ptr = &o.emplace_or_replace<Components::TFTFile2>(std::move(file2));
+		file2_comp_ptr->reopenable = true;
+
+		if (o.all_of<Components::TFTFileClosed>()) {
+			o.remove<Components::TFTFileClosed>();
+			_stats.file_reopens++;
+		}
 	}
 	assert(file2_comp_ptr != nullptr);
 	assert(static_cast<bool>(file2_comp_ptr->file));
 
-	file2_comp_ptr->last_activity_ts = getTimeMS();
+	file2_comp_ptr->last_activity_ts = _tcm.tickClock().now();
 
 	return file2_comp_ptr->file.get();
 }
 
 File2I* ToxTransferManager::objGetFile2Read(ObjectHandle o) {
 	auto* file2_comp_ptr = o.try_get<Components::TFTFile2>();
-	if (file2_comp_ptr == nullptr || !file2_comp_ptr->file || !file2_comp_ptr->file->can_read || !file2_comp_ptr->file->isGood()) {
-		std::cout << "TTM: (re)opening object " << entt::to_integral(entt::to_entity(o.entity())) << " for reading\n";
+	if (
+		file2_comp_ptr == nullptr ||
+		!file2_comp_ptr->file ||
+		!file2_comp_ptr->file->can_read ||
+		// cant ask the file while a worker uses it
+		(!o.all_of<Components::TFTIOPending>() && !file2_comp_ptr->file->isGood())
+	) {
+		TOX_LOG_DEBUG("TTM") << "(re)opening object " << entt::to_integral(entt::to_entity(o.entity())) << " for reading";
 		// (re)request file2 from backend
 		auto* file_backend = o.get<ObjComp::Ephemeral::BackendFile2>().ptr;
 		if (file_backend == nullptr) {
-			std::cerr << "TTM error: object backend nullptr\n";
+			TOX_LOG_ERROR("TTM") << "object backend nullptr";
 			return nullptr;
 		}
 
 		//auto new_file = _mfb.file2(o, StorageBackendIFile2::FILE2_READ);
 		auto file2 = file_backend->file2(o, StorageBackendIFile2::FILE2_READ);
 		if (!file2 || !file2->isGood() || !file2->can_read) {
-			std::cerr << "TTM error: creating file2 from object via backendI\n";
+			TOX_LOG_ERROR("TTM") << "creating file2 from object via backendI";
 			return nullptr;
 		}
 
-		file2_comp_ptr = &o.emplace_or_replace<Components::TFTFile2>(std::move(file2), getTimeMS());
+		file2_comp_ptr = &o.emplace_or_replace<Components::TFTFile2>(std::move(file2));
+		file2_comp_ptr->reopenable = true;
+
+		if (o.all_of<Components::TFTFileClosed>()) {
+			o.remove<Components::TFTFileClosed>();
+			_stats.file_reopens++;
+		}
+
+		// might have changed while closed
+		if (auto* ra_ptr = o.try_get<Components::TFTReadAhead>(); ra_ptr != nullptr) {
+			ra_ptr->file_mtime = fileMTime(o);
+		}
 	}
 	assert(file2_comp_ptr != nullptr);
 	assert(static_cast<bool>(file2_comp_ptr->file));
 
-	file2_comp_ptr->last_activity_ts = getTimeMS();
+	file2_comp_ptr->last_activity_ts = _tcm.tickClock().now();
 
 	return file2_comp_ptr->file.get();
 }
 
+void ToxTransferManager::objSubmitRead(ObjectHandle o, const uint64_t position, const uint64_t size) {
+	auto& ra = o.get<Components::TFTReadAhead>();
+	assert(!ra.read_pending);
+
+	ToxTransferIO::Job job;
+	job.type = ToxTransferIO::Job::Type::read;
+	job.o = o.entity();
+	job.file = o.get<Components::TFTFile2>().file;
+	job.position = position;
+	job.size = size;
+	// the result is shared with the read cache, no buffer reuse
+	ra.next.reset();
+
+	ra.read_pending = true;
+	o.get_or_emplace<Components::TFTIOPending>().reads++;
+	_stats.io_async_reads++;
+
+	_io->submit(std::move(job));
+}
+
+ToxBlockCache::Block ToxTransferManager::objReadCacheGet(ObjectHandle o, const uint64_t position, const uint64_t size) {
+	const auto* sil = o.try_get<ObjComp::F::SingleInfoLocal>();
+	const auto* si = o.try_get<ObjComp::F::SingleInfo>();
+	const auto* ra = o.try_get<Components::TFTReadAhead>();
+	if (sil == nullptr || si == nullptr || ra == nullptr || sil->file_path.empty() || ra->file_mtime < 0) {
+		return nullptr;
+	}
+
+	return _read_cache.get(sil->file_path, si->file_size, ra->file_mtime, position, size);
+}
+
+void ToxTransferManager::objReadCachePut(ObjectHandle o, const uint64_t position, ToxBlockCache::Block data) {
+	const auto* sil = o.try_get<ObjComp::F::SingleInfoLocal>();
+	const auto* si = o.try_get<ObjComp::F::SingleInfo>();
+	const auto* ra = o.try_get<Components::TFTReadAhead>();
+	if (sil == nullptr || si == nullptr || ra == nullptr || sil->file_path.empty() || ra->file_mtime < 0) {
+		return;
+	}
+
+	_read_cache.put(sil->file_path, si->file_size, ra->file_mtime, position, std::move(data));
+}
+
+void ToxTransferManager::processIOCompletions(void) {
+	if (!_io || _io->inFlight() == 0) {
+		return;
+	}
+
+	_io->poll([this](ToxTransferIO::Job& job) {
+		if (!_os.registry().valid(job.o)) {
+			return; // object destroyed
+		}
+		ObjectHandle o {_os.registry(), job.o};
+
+		bool io_done {false};
+		bool write_failed {false};
+		if (auto* pending_ptr = o.try_get<Components::TFTIOPending>(); pending_ptr != nullptr) {
+			if (job.type == ToxTransferIO::Job::Type::read) {
+				assert(pending_ptr->reads > 0);
+				pending_ptr->reads--;
+			} else {
+				assert(pending_ptr->writes > 0);
+				pending_ptr->writes--;
+				pending_ptr->write_failed = pending_ptr->write_failed || !job.success;
+			}
+
+			write_failed = pending_ptr->write_failed;
+
+			if (pending_ptr->reads == 0 && pending_ptr->writes == 0) {
+				io_done = true;
+				o.remove<Components::TFTIOPending>();
+			}
+		}
+
+		if (job.type == ToxTransferIO::Job::Type::read) {
+			auto* ra_ptr = o.try_get<Components::TFTReadAhead>();
+			if (ra_ptr == nullptr) {
+				return; // transfer gone
+			}
+
+			ra_ptr->read_pending = false;
+
+			if (!job.success) {
+				TOX_LOG_ERROR("TTM") << "failed to read file!!";
+				ra_ptr->parked.clear();
+
+				// toxcore does not ask again for the parked chunks
+				if (const auto* ttf_ptr = o.try_get<ObjComp::Ephemeral::ToxTransferFriend>(); ttf_ptr != nullptr) {
+					_t.toxFileControl(ttf_ptr->friend_number, ttf_ptr->transfer_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
+
+					// update lookup table and free resources
+					toxTransferCleanup(o);
+
+					_os.throwEventUpdate(o);
+				}
+				return;
+			}
+
+			ra_ptr->next = std::make_shared<const std::vector<uint8_t>>(std::move(job.data));
+			ra_ptr->next_position = job.position;
+
+			objReadCachePut(o, ra_ptr->next_position, ra_ptr->next);
+
+			// serve the requests that waited for this, in order.
+			// if one misses again, it and all after it are parked again
+			const auto parked = std::move(ra_ptr->parked);
+			ra_ptr->parked.clear();
+			for (const auto& [position, size] : parked) {
+				const auto* ttf_ptr = o.try_get<ObjComp::Ephemeral::ToxTransferFriend>();
+				if (ttf_ptr == nullptr || !o.all_of<Components::TFTReadAhead>()) {
+					break; // transfer gone
+				}
+
+				handleChunkRequest(o, ttf_ptr->friend_number, ttf_ptr->transfer_number, position, size);
+			}
+		} else {
+			if (job.success) {
+				objAddReceivedRange(o, job.position, job.data.size());
+			}
+
+			if (_write_buffer_pool.size() < 16) {
+				job.data.clear();
+				_write_buffer_pool.push_back(std::move(job.data));
+			}
+
+			if (!job.success) {
+				TOX_LOG_ERROR("TTM") << "failed to write file, object " << entt::to_integral(job.o);
+
+				if (const auto* ttf_ptr = o.try_get<ObjComp::Ephemeral::ToxTransferFriend>(); ttf_ptr != nullptr) {
+					_t.toxFileControl(ttf_ptr->friend_number, ttf_ptr->transfer_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
+
+					// update lookup table and free resources
+					toxTransferCleanup(o);
+
+					_os.throwEventUpdate(o);
+				}
+			}
+
+			if (io_done && o.all_of<Components::TFTFinishPending>()) {
+				const auto friend_number = o.get<Components::TFTFinishPending>().friend_number;
+				o.remove<Components::TFTFinishPending>();
+
+				if (write_failed) {
+					TOX_LOG_ERROR("TTM") << "failed writing end of object " << entt::to_integral(job.o);
+					_os.throwEventUpdate(o);
+				} else {
+					finishRecv(o, friend_number);
+				}
+			}
+		}
+	});
+}
+
 ToxTransferManager::ToxTransferManager(
 	RegistryMessageModelI& rmm,
 	ContactStore4I& cs,
@@ -144,7 +815,7 @@ ToxTransferManager::ToxTransferManager(
 	ToxI& t,
 	ToxEventProviderI& tep,
 	ObjectStore2& os
-) : _rmm(rmm), _rmm_sr(_rmm.newSubRef(this)), _cs(cs), _tcm(tcm), _t(t), _tep_sr(tep.newSubRef(this)), _os(os), _os_sr(_os.newSubRef(this)), _ftb(os) {
+) : _rmm(rmm), _rmm_sr(_rmm.newSubRef(this)), _cs(cs), _tcm(tcm), _t(t), _tep_sr(tep.newSubRef(this)), _os(os), _os_sr(_os.newSubRef(this)), _ftb(os), _ftm(os) {
 	_tep_sr
 		.subscribe(Tox_Event_Type::TOX_EVENT_FRIEND_CONNECTION_STATUS)
 		.subscribe(Tox_Event_Type::TOX_EVENT_FILE_RECV)
@@ -153,42 +824,553 @@ ToxTransferManager::ToxTransferManager(
 		.subscribe(Tox_Event_Type::TOX_EVENT_FILE_CHUNK_REQUEST)
 	;
 
-	_os_sr
-		.subscribe(ObjectStore_Event::object_update)
-		.subscribe(ObjectStore_Event::object_destroy)
-	;
+	_os_sr
+		.subscribe(ObjectStore_Event::object_construct)
+		.subscribe(ObjectStore_Event::object_update)
+		.subscribe(ObjectStore_Event::object_destroy)
+	;
+
+	_rmm_sr
+		.subscribe(RegistryMessageModel_Event::send_file_path)
+		.subscribe(RegistryMessageModel_Event::send_file_obj)
+	;
+
+	// io stays synchronous unless setAsyncIO() is called
+}
+
+ToxTransferManager::~ToxTransferManager(void) {
+}
+
+bool ToxTransferManager::setAsyncIO(size_t thread_count) {
+	if (_io && _io->inFlight() != 0) {
+		return false;
+	}
+
+	if (thread_count == 0) {
+		_io.reset();
+	} else {
+		_io = std::make_unique<ToxTransferIO>(thread_count);
+	}
+
+	return true;
+}
+
+void ToxTransferManager::iterate(void) {
+	// own time, not the one of the last event batch
+	_tcm.tickClock().tick();
+
+	processIOCompletions();
+
+	dispatchSendQueue();
+
+	scheduleTransfers();
+
+	retrySendChunks();
+
+	processChunkQueue();
+
+	// chunks processed after a pause would otherwise sit in memory
+	for (const auto ov : _os.registry().view<Components::TFTWriteBehind, ObjComp::Ephemeral::File::TagTransferPaused>()) {
+		objFlushWriteBehind({_os.registry(), ov});
+	}
+
+	closeIdleFiles();
+
+	processStalledTransfers();
+
+	updateTransferRates();
+
+	flushProgressUpdates();
+
+	// the next event batch samples again
+	_tcm.tickClock().tick();
+}
+
+void ToxTransferManager::updateTransferRates(void) {
+	const uint64_t ts_now = _tcm.tickClock().now();
+	if (ts_now - _last_rate_ts < _rate_window_ms) {
+		return;
+	}
+	_last_rate_ts = ts_now;
+
+	auto& reg = _os.registry();
+
+	// ended transfers
+	std::vector<Object> ended;
+	for (const auto ov : reg.view<Components::TFTRateWindow>(entt::exclude<ObjComp::Ephemeral::ToxTransferFriend>)) {
+		ended.push_back(ov);
+	}
+	for (const auto ov : ended) {
+		reg.remove<Components::TFTRateWindow>(ov);
+		if (auto* rate_ptr = reg.try_get<ObjComp::Ephemeral::ToxTransferRate>(ov); rate_ptr != nullptr) {
+			const bool have_all = reg.all_of<ObjComp::F::TagLocalHaveAll>(ov);
+			*rate_ptr = {};
+			rate_ptr->eta = have_all ? 0.f : -1.f;
+		}
+	}
+
+	_friend_rates.clear();
+
+	for (const auto& [ov, ttf, tstats] : reg.view<ObjComp::Ephemeral::ToxTransferFriend, ObjComp::Ephemeral::File::TransferStats>().each()) {
+		auto& window = reg.get_or_emplace<Components::TFTRateWindow>(ov, tstats.total_up, tstats.total_down, ts_now);
+		const bool new_rate = !reg.all_of<ObjComp::Ephemeral::ToxTransferRate>(ov);
+		auto& rate = reg.get_or_emplace<ObjComp::Ephemeral::ToxTransferRate>(ov);
+		const auto prev_rate = rate;
+
+		if (ts_now > window.ts) {
+			const float dt = (ts_now - window.ts) / 1000.f;
+			rate.up = (tstats.total_up - window.total_up) / dt;
+			rate.down = (tstats.total_down - window.total_down) / dt;
+
+			rate.up_avg = _rate_ewma_alpha * rate.up + (1.f - _rate_ewma_alpha) * rate.up_avg;
+			rate.down_avg = _rate_ewma_alpha * rate.down + (1.f - _rate_ewma_alpha) * rate.down_avg;
+
+			// the average of an idle transfer settles, instead of decaying forever
+			if (rate.up_avg < 1.f) {
+				rate.up_avg = 0.f;
+			}
+			if (rate.down_avg < 1.f) {
+				rate.down_avg = 0.f;
+			}
+
+			window = {tstats.total_up, tstats.total_down, ts_now};
+		}
+
+		const bool outgoing = reg.all_of<ObjComp::Tox::TagOutgoing>(ov);
+		const float rate_avg = outgoing ? rate.up_avg : rate.down_avg;
+		uint64_t remaining {0};
+		rate.eta = -1.f;
+		if (const auto* si = reg.try_get<ObjComp::F::SingleInfo>(ov); si != nullptr && si->file_size != UINT64_MAX) {
+			const uint64_t done = outgoing ? tstats.total_up : tstats.total_down;
+			remaining = si->file_size > done ? si->file_size - done : 0;
+			if (rate_avg > 0.f) {
+				rate.eta = remaining / rate_avg;
+			}
+		}
+
+		auto& fr = _friend_rates[ttf.friend_number];
+		fr.up += rate.up;
+		fr.down += rate.down;
+		fr.up_avg += rate.up_avg;
+		fr.down_avg += rate.down_avg;
+		fr.transfers++;
+		// eta is the slowest of the transfers
+		if (rate.eta < 0.f || (fr.transfers > 1 && fr.eta < 0.f)) {
+			fr.eta = -1.f;
+		} else {
+			fr.eta = std::max(fr.eta, rate.eta);
+		}
+
+		// idle (paused, not accepted) transfers dont throw updates
+		if (
+			new_rate ||
+			rate.up != prev_rate.up || rate.down != prev_rate.down ||
+			rate.up_avg != prev_rate.up_avg || rate.down_avg != prev_rate.down_avg ||
+			rate.eta != prev_rate.eta
+		) {
+			// thrown with the next progress update
+			reg.get_or_emplace<Components::TFTProgress>(ov);
+			reg.emplace_or_replace<Components::TFTProgressDirty>(ov);
+		}
+	}
+}
+
+const ToxTransferManager::FriendRate* ToxTransferManager::friendRate(uint32_t friend_number) const {
+	const auto it = _friend_rates.find(friend_number);
+	if (it == _friend_rates.end()) {
+		return nullptr;
+	}
+	return &it->second;
+}
+
+void ToxTransferManager::objProgressUpdate(ObjectHandle o) {
+	const uint64_t ts_now = _tcm.tickClock().now();
+
+	auto& progress = o.get_or_emplace<Components::TFTProgress>();
+	if (_progress_interval_ms == 0 || ts_now - progress.last_event_ts >= _progress_interval_ms) {
+		progress.last_event_ts = ts_now;
+		o.remove<Components::TFTProgressDirty>();
+		_os.throwEventUpdate(o);
+	} else {
+		// picked up in iterate()
+		o.emplace_or_replace<Components::TFTProgressDirty>();
+	}
+}
+
+void ToxTransferManager::flushProgressUpdates(void) {
+	const uint64_t ts_now = _tcm.tickClock().now();
+
+	std::vector<Object> due;
+	for (const auto& [ov, progress] : _os.registry().view<Components::TFTProgressDirty, Components::TFTProgress>().each()) {
+		if (_progress_interval_ms == 0 || ts_now - progress.last_event_ts >= _progress_interval_ms) {
+			due.push_back(ov);
+		}
+	}
+
+	// event handlers might modify the storage
+	for (const auto ov : due) {
+		if (!_os.registry().valid(ov) || !_os.registry().all_of<Components::TFTProgressDirty>(ov)) {
+			continue;
+		}
+		ObjectHandle o {_os.registry(), ov};
+		o.get<Components::TFTProgress>().last_event_ts = ts_now;
+		o.remove<Components::TFTProgressDirty>();
+		_os.throwEventUpdate(o);
+	}
+}
+
+void ToxTransferManager::objTouchActivity(ObjectHandle o) {
+	auto& act = o.get_or_emplace<Components::TFTActivity>();
+	act.ts = _tcm.tickClock().now();
+
+	if (!act.in_wheel && _stall_timeout_ms != 0) {
+		act.in_wheel = true;
+		stallWheelInsert(o.entity(), act.ts + _stall_timeout_ms);
+	}
+}
+
+void ToxTransferManager::stallWheelInsert(Object ov, const uint64_t due_ms) {
+	const uint64_t due_s = due_ms/1000;
+
+	uint64_t delta {1};
+	if (due_s > _stall_wheel_ts) {
+		delta = std::min<uint64_t>(due_s - _stall_wheel_ts, _stall_wheel.size()-1);
+	}
+
+	_stall_wheel.at((_stall_wheel_pos + delta) % _stall_wheel.size()).push_back(ov);
+}
+
+void ToxTransferManager::processStalledTransfers(void) {
+	const uint64_t ts_now = _tcm.tickClock().now();
+	const uint64_t now_s = ts_now/1000;
+
+	if (_stall_wheel_ts == 0) {
+		_stall_wheel_ts = now_s;
+		return;
+	}
+
+	// after a long iterate() gap, one round over the wheel is enough
+	if (now_s - _stall_wheel_ts > _stall_wheel.size()) {
+		_stall_wheel_ts = now_s - _stall_wheel.size();
+	}
+
+	std::vector<Object> slot;
+	while (_stall_wheel_ts < now_s) {
+		_stall_wheel_ts++;
+		_stall_wheel_pos = (_stall_wheel_pos + 1) % _stall_wheel.size();
+
+		if (_stall_wheel[_stall_wheel_pos].empty()) {
+			continue;
+		}
+
+		slot.clear();
+		std::swap(slot, _stall_wheel[_stall_wheel_pos]);
+
+		for (const auto ov : slot) {
+			if (!_os.registry().valid(ov)) {
+				continue;
+			}
+			ObjectHandle o {_os.registry(), ov};
+
+			auto* act_ptr = o.try_get<Components::TFTActivity>();
+			if (act_ptr == nullptr) {
+				continue;
+			}
+
+			// no longer active (finished, canceled, disconnected)
+			if (_stall_timeout_ms == 0 || !o.all_of<ObjComp::Ephemeral::ToxTransferFriend>()) {
+				o.remove<Components::TFTActivity>();
+				continue;
+			}
+
+			if (
+				// waiting on purpose
+				o.any_of<ObjComp::Ephemeral::File::TagTransferPaused, Components::TFTSchedPaused>() ||
+				// still making progress
+				o.all_of<Components::TFTIOPending>() ||
+				// waiting for the stream producer
+				(o.all_of<Components::TFTStreamBuffer>() && !o.get<Components::TFTStreamBuffer>().waiting.empty())
+			) {
+				act_ptr->ts = ts_now;
+			}
+
+			if (ts_now - act_ptr->ts < _stall_timeout_ms) {
+				stallWheelInsert(ov, act_ptr->ts + _stall_timeout_ms);
+				continue;
+			}
+
+			act_ptr->in_wheel = false;
+			handleStall(o);
+		}
+	}
+}
+
+void ToxTransferManager::handleStall(ObjectHandle o) {
+	const auto [friend_number, transfer_number] = o.get<ObjComp::Ephemeral::ToxTransferFriend>();
+
+	TOX_LOG_WARNING("TTM") << "transfer stalled e:" << entt::to_integral(o.entity()) << " frd:" << friend_number << " fnb:" << transfer_number;
+
+	_stats.transfers_timed_out++;
+
+	// keep what we got
+	objFlushWriteBehind(o);
+
+	if (_stall_action == StallAction::cancel) {
+		_t.toxFileControl(friend_number, transfer_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
+
+		// update lookup table and free resources
+		toxTransferCleanup(o);
+	} else {
+		_t.toxFileControl(friend_number, transfer_number, Tox_File_Control::TOX_FILE_CONTROL_PAUSE);
+		o.emplace_or_replace<ObjComp::Ephemeral::File::TagTransferPaused>();
+		o.emplace_or_replace<Components::TFTLocalPaused>();
+		o.remove<Components::TFTSchedPaused>();
+
+		// reopened on resume
+		if (const auto* file2_ptr = o.try_get<Components::TFTFile2>(); file2_ptr != nullptr && file2_ptr->reopenable && !o.all_of<Components::TFTIOPending>()) {
+			o.remove<Components::TFTFile2>();
+			o.emplace_or_replace<Components::TFTFileClosed>();
+		}
+		o.remove<Components::TFTReadAhead, Components::TFTWriteBehind>();
+	}
+
+	o.emplace_or_replace<ObjComp::Ephemeral::ToxTransferTimedOut>(_tcm.tickClock().now());
+
+	_os.throwEventUpdate(o);
+}
+
+void ToxTransferManager::closeIdleFiles(void) {
+	const uint64_t ts_now = _tcm.tickClock().now();
+	if (ts_now - _last_file_sweep_ts < 1000) {
+		return; // once a second is plenty
+	}
+	_last_file_sweep_ts = ts_now;
+
+	// (last activity, object) of all handles that could be closed
+	std::vector<std::pair<uint64_t, Object>> candidates;
+	size_t open_count {0};
+	for (const auto& [ov, file2] : _os.registry().view<Components::TFTFile2>().each()) {
+		if (!file2.file) {
+			continue;
+		}
+		open_count++;
+
+		if (!file2.reopenable) {
+			continue;
+		}
+
+		// in use by a worker
+		if (_os.registry().all_of<Components::TFTIOPending>(ov)) {
+			continue;
+		}
+
+		// would need a flush first
+		if (const auto* wb_ptr = _os.registry().try_get<Components::TFTWriteBehind>(ov); wb_ptr != nullptr && !wb_ptr->buffer.empty()) {
+			continue;
+		}
+
+		candidates.emplace_back(file2.last_activity_ts, ov);
+	}
+
+	if (candidates.empty()) {
+		return;
+	}
+
+	// oldest first
+	std::sort(candidates.begin(), candidates.end());
+
+	size_t over_budget {0};
+	if (_max_open_files != 0 && open_count > _max_open_files) {
+		over_budget = open_count - _max_open_files;
+	}
+
+	for (const auto& [last_activity_ts, ov] : candidates) {
+		const bool idle = _file_idle_timeout_ms != 0 && ts_now - last_activity_ts >= _file_idle_timeout_ms;
+		if (over_budget == 0 && !idle) {
+			break;
+		}
+
+		ObjectHandle o {_os.registry(), ov};
+		o.remove<Components::TFTFile2>();
+		o.emplace_or_replace<Components::TFTFileClosed>();
+		_stats.file_evictions++;
+
+		if (over_budget != 0) {
+			over_budget--;
+		}
+	}
+}
+
+void ToxTransferManager::processChunkQueue(void) {
+	// older requests first
+	serveThrottledChunks();
+
+	if (_chunk_queue.empty()) {
+		return;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	const std::chrono::microseconds budget{_chunk_budget_us};
+
+	// always make progress, even if the budget is tiny
+	do {
+		auto qc = std::move(_chunk_queue.front());
+		_chunk_queue.pop_front();
+
+		if (processQueuedChunk(qc, false) && qc.data.capacity() != 0) {
+			qc.data.clear();
+			_chunk_data_pool.push_back(std::move(qc.data));
+		}
+	} while (
+		!_chunk_queue.empty() &&
+		(_chunk_budget_us == 0 || std::chrono::steady_clock::now() - start < budget)
+	);
+}
+
+bool ToxTransferManager::processQueuedChunk(QueuedChunk& qc, bool from_throttled) {
+	// the transfer might have been canceled/finished/disconnected since
+	ObjectHandle o = qc.is_request
+		? toxFriendLookupSending(qc.friend_number, qc.file_number)
+		: toxFriendLookupReceiving(qc.friend_number, qc.file_number)
+	;
+	if (!static_cast<bool>(o) || o.entity() != qc.o) {
+		return true;
+	}
+
+	if (!qc.is_request) {
+		handleRecvChunk(o, qc.friend_number, qc.file_number, qc.position, ByteSpan{qc.data});
+		return true;
+	}
+
+	// keep the order behind already deferred requests
+	// (including the final 0 size request)
+	const bool friend_throttled = !from_throttled && _throttled_chunks.count(qc.friend_number);
+	// only checked here, charged once the chunk is sent
+	if (friend_throttled || (qc.size != 0 && !bandwidthAvailable(qc.friend_number, qc.size))) {
+		if (!from_throttled) {
+			_stats.throttled_chunks++;
+			_stats.throttled_bytes += qc.size;
+			_throttled_chunks[qc.friend_number].push_back(std::move(qc));
+		}
+		return false;
+	}
+
+	handleChunkRequest(o, qc.friend_number, qc.file_number, qc.position, qc.size);
+	return true;
+}
+
+ToxTokenBucket& ToxTransferManager::friendBucket(const uint32_t friend_number) {
+	auto it = _friend_buckets.find(friend_number);
+	if (it == _friend_buckets.end()) {
+		it = _friend_buckets.emplace(friend_number, ToxTokenBucket{}).first;
+
+		const auto limit_it = _friend_bandwidth_limits.find(friend_number);
+		it->second.setRate(limit_it != _friend_bandwidth_limits.end() ? limit_it->second : _friend_bandwidth_default);
+	}
+	return it->second;
+}
+
+bool ToxTransferManager::bandwidthLimited(void) const {
+	return !_bandwidth_bucket.unlimited() || _friend_bandwidth_default != 0 || !_friend_bandwidth_limits.empty();
+}
+
+bool ToxTransferManager::bandwidthAvailable(const uint32_t friend_number, const uint64_t size) {
+	if (!bandwidthLimited()) {
+		return true;
+	}
+
+	const uint64_t ts_now = _tcm.tickClock().now();
+
+	_bandwidth_bucket.refill(ts_now);
+	auto& friend_bucket = friendBucket(friend_number);
+	friend_bucket.refill(ts_now);
+
+	return _bandwidth_bucket.canTake(size) && friend_bucket.canTake(size);
+}
+
+void ToxTransferManager::bandwidthCharge(const uint32_t friend_number, const uint64_t size) {
+	if (!bandwidthLimited()) {
+		return;
+	}
+
+	_bandwidth_bucket.take(size);
+	friendBucket(friend_number).take(size);
+}
+
+void ToxTransferManager::serveThrottledChunks(void) {
+	if (_throttled_chunks.empty()) {
+		return;
+	}
+
+	std::vector<uint32_t> emptied;
+	for (auto& [friend_number, queue] : _throttled_chunks) {
+		while (!queue.empty() && processQueuedChunk(queue.front(), true)) {
+			queue.pop_front();
+		}
+
+		if (queue.empty()) {
+			emptied.push_back(friend_number);
+		}
+	}
+
+	for (const auto friend_number : emptied) {
+		_throttled_chunks.erase(friend_number);
+	}
+}
+
+void ToxTransferManager::setBandwidthLimit(uint64_t rate) {
+	_bandwidth_bucket.setRate(rate);
+}
 
-	_rmm_sr
-		.subscribe(RegistryMessageModel_Event::send_file_path)
-		.subscribe(RegistryMessageModel_Event::send_file_obj)
-	;
+void ToxTransferManager::setFriendBandwidthLimit(uint64_t rate) {
+	_friend_bandwidth_default = rate;
+
+	for (auto& [friend_number, bucket] : _friend_buckets) {
+		if (!_friend_bandwidth_limits.count(friend_number)) {
+			bucket.setRate(rate);
+		}
+	}
 }
 
-ToxTransferManager::~ToxTransferManager(void) {
+void ToxTransferManager::setFriendBandwidthLimit(uint32_t friend_number, uint64_t rate) {
+	_friend_bandwidth_limits[friend_number] = rate;
+	friendBucket(friend_number).setRate(rate);
 }
 
-void ToxTransferManager::iterate(void) {
-	// TODO: time out transfers
+size_t ToxTransferManager::throttledChunkCount(void) const {
+	size_t count {0};
+	for (const auto& [friend_number, queue] : _throttled_chunks) {
+		count += queue.size();
+	}
+	return count;
 }
 
 Message3Handle ToxTransferManager::toxSendFilePath(const Contact4 c, uint32_t file_kind, std::string_view file_name, std::string_view file_path, std::vector<uint8_t> file_id) {
 	const auto& cr = _cs.registry();
 	if (
-		// TODO: add support of offline queuing
-		!cr.all_of<Contact::Components::ToxFriendEphemeral>(c)
+		// offline friends get queued
+		!cr.any_of<Contact::Components::ToxFriendEphemeral, Contact::Components::ToxFriendPersistent>(c)
 	) {
-		std::cerr << "TTM error: unsupported contact type\n";
+		TOX_LOG_ERROR("TTM") << "unsupported contact type";
+		return {};
+	}
+
+	std::error_code ec;
+	const uint64_t file_size = std::filesystem::file_size(std::filesystem::u8path(file_path), ec);
+	if (ec) {
+		TOX_LOG_ERROR("TTM") << "failed getting size of file '" << file_path << "'!";
 		return {};
 	}
 
-	auto file_impl = std::make_unique<File2RFile>(file_path);
-	if (!file_impl->isGood()) {
-		std::cerr << "TTM error: failed opening file '" << file_path << "'!\n";
+	auto file_impl = _ftb.openFileRead(file_path, file_size);
+	if (!file_impl || !file_impl->isGood()) {
+		TOX_LOG_ERROR("TTM") << "failed opening file '" << file_path << "'!";
 		return {};
 	}
 
 	// get current time unix epoch utc
-	uint64_t ts = getTimeMS();
+	// not part of an event batch
+	uint64_t ts = _tcm.tickClock().nowPrecise();
 
 	if (file_id.empty()) {
 		file_id.resize(32);
@@ -201,7 +1383,14 @@ Message3Handle ToxTransferManager::toxSendFilePath(const Contact4 c, uint32_t fi
 
 	const auto c_self = cr.get<Contact::Components::Self>(c).self;
 	if (!cr.valid(c_self)) {
-		std::cerr << "TTM error: failed to get self!\n";
+		TOX_LOG_ERROR("TTM") << "failed to get self!";
+		return {};
+	}
+
+	// before creating the object, nothing to clean up
+	auto* reg_ptr = _rmm.get(c);
+	if (reg_ptr == nullptr) {
+		TOX_LOG_ERROR("TTM") << "no message registry for contact";
 		return {};
 	}
 
@@ -210,11 +1399,12 @@ Message3Handle ToxTransferManager::toxSendFilePath(const Contact4 c, uint32_t fi
 
 	o.emplace<ObjComp::F::TagLocalHaveAll>();
 	o.emplace<ObjComp::Tox::TagOutgoing>();
+	o.emplace<ObjComp::Ephemeral::ToxContact>(_cs.contactHandle(c));
 	o.emplace<ObjComp::Tox::FileKind>(file_kind);
 	o.emplace<ObjComp::Tox::FileID>(file_id);
 
 	// file info
-	o.emplace<ObjComp::F::SingleInfo>(std::string{file_name}, file_impl->_file_size);
+	o.emplace<ObjComp::F::SingleInfo>(std::string{file_name}, file_size);
 	o.emplace<ObjComp::F::SingleInfoLocal>(std::string{file_path});
 	o.emplace<ObjComp::Ephemeral::FilePath>(std::string{file_path}); // ?
 
@@ -223,11 +1413,6 @@ Message3Handle ToxTransferManager::toxSendFilePath(const Contact4 c, uint32_t fi
 	// TODO: replace with better state tracking
 	o.emplace<ObjComp::Ephemeral::File::TagTransferPaused>();
 
-	auto* reg_ptr = _rmm.get(c);
-	if (reg_ptr == nullptr) {
-		return {};
-	}
-
 	Message3Handle msg {*reg_ptr, reg_ptr->create()};
 	msg.emplace<Message::Components::ContactTo>(c);
 	msg.emplace<Message::Components::ContactFrom>(c_self);
@@ -236,16 +1421,10 @@ Message3Handle ToxTransferManager::toxSendFilePath(const Contact4 c, uint32_t fi
 	msg.emplace<Message::Components::ReceivedBy>().ts.try_emplace(c_self, ts);
 	msg.emplace<Message::Components::MessageFileObject>(o);
 
-	const auto friend_number = cr.get<Contact::Components::ToxFriendEphemeral>(c).friend_number;
-	const auto&& [transfer_id, err] = _t.toxFileSend(friend_number, file_kind, file_impl->_file_size, file_id, file_name);
-	if (err == TOX_ERR_FILE_SEND_OK) {
-		assert(transfer_id.has_value());
-		o.emplace<ObjComp::Ephemeral::ToxTransferFriend>(friend_number, transfer_id.value());
-		o.emplace<Components::TFTFile2>(std::move(file_impl));
-		// TODO: add tag signifying init sent status?
+	// the backend opens SingleInfoLocal again
+	o.emplace<Components::TFTFile2>(std::move(file_impl)).reopenable = true;
 
-		toxFriendLookupAdd(o);
-	} // else queue?
+	objSendOrQueue(o, c);
 
 	_os.throwEventConstruct(o);
 	_rmm.throwEventConstruct(msg);
@@ -254,14 +1433,14 @@ Message3Handle ToxTransferManager::toxSendFilePath(const Contact4 c, uint32_t fi
 
 bool ToxTransferManager::resume(ObjectHandle transfer) {
 	if (!static_cast<bool>(transfer)) {
-		std::cerr << "TTM error: resume() transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer\n";
+		TOX_LOG_ERROR("TTM") << "resume() transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer";
 		return false;
 	}
 
 	// TODO: test for paused?
 
 	if (!transfer.all_of<ObjComp::Ephemeral::ToxTransferFriend>()) {
-		std::cerr << "TTM error: resume() transfer " << entt::to_integral(transfer.entity()) << " ent does not have toxtransfer info\n";
+		TOX_LOG_ERROR("TTM") << "resume() transfer " << entt::to_integral(transfer.entity()) << " ent does not have toxtransfer info";
 		return false;
 	}
 
@@ -269,11 +1448,19 @@ bool ToxTransferManager::resume(ObjectHandle transfer) {
 
 	const auto err = _t.toxFileControl(friend_number, transfer_number, TOX_FILE_CONTROL_RESUME);
 	if (err != TOX_ERR_FILE_CONTROL_OK) {
-		std::cerr << "TTM error: resume() transfer " << entt::to_integral(transfer.entity()) << " tox file control error " << err << "\n";
+		TOX_LOG_ERROR("TTM") << "resume() transfer " << entt::to_integral(transfer.entity()) << " tox file control error " << err;
 		return false;
 	}
 
-	transfer.remove<ObjComp::Ephemeral::File::TagTransferPaused>();
+	transfer.remove<
+		ObjComp::Ephemeral::ToxTransferTimedOut,
+		Components::TFTSchedPaused,
+		Components::TFTLocalPaused
+	>();
+	if (!transfer.all_of<Components::TFTRemotePaused>()) {
+		transfer.remove<ObjComp::Ephemeral::File::TagTransferPaused>();
+	}
+	objTouchActivity(transfer);
 
 	_os.throwEventUpdate(transfer);
 
@@ -282,26 +1469,36 @@ bool ToxTransferManager::resume(ObjectHandle transfer) {
 
 bool ToxTransferManager::pause(ObjectHandle transfer) {
 	if (!static_cast<bool>(transfer)) {
-		std::cerr << "TTM error: pause() transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer\n";
+		TOX_LOG_ERROR("TTM") << "pause() transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer";
 		return false;
 	}
 
 	// TODO: test for paused?
 
 	if (!transfer.all_of<ObjComp::Ephemeral::ToxTransferFriend>()) {
-		std::cerr << "TTM error: pause() transfer " << entt::to_integral(transfer.entity()) << " ent does not have toxtransfer info\n";
+		TOX_LOG_ERROR("TTM") << "pause() transfer " << entt::to_integral(transfer.entity()) << " ent does not have toxtransfer info";
 		return false;
 	}
 
 	const auto [friend_number, transfer_number] = transfer.get<ObjComp::Ephemeral::ToxTransferFriend>();
 
-	const auto err = _t.toxFileControl(friend_number, transfer_number, TOX_FILE_CONTROL_PAUSE);
-	if (err != TOX_ERR_FILE_CONTROL_OK) {
-		std::cerr << "TTM error: pause() transfer " << entt::to_integral(transfer.entity()) << " tox file control error " << err << "\n";
-		return false;
+	// already paused on our side by the scheduler, the user takes over
+	if (!transfer.all_of<Components::TFTSchedPaused>()) {
+		const auto err = _t.toxFileControl(friend_number, transfer_number, TOX_FILE_CONTROL_PAUSE);
+		if (err != TOX_ERR_FILE_CONTROL_OK) {
+			TOX_LOG_ERROR("TTM") << "pause() transfer " << entt::to_integral(transfer.entity()) << " tox file control error " << err;
+			return false;
+		}
 	}
 
 	transfer.emplace_or_replace<ObjComp::Ephemeral::File::TagTransferPaused>();
+	// the scheduler replaces it with TFTSchedPaused if it was the caller
+	transfer.emplace_or_replace<Components::TFTLocalPaused>();
+	transfer.remove<Components::TFTSchedPaused>();
+
+	if (!objFlushWriteBehind(transfer)) {
+		TOX_LOG_ERROR("TTM") << "pause() transfer " << entt::to_integral(transfer.entity()) << " failed to write buffered data";
+	}
 
 	_os.throwEventUpdate(transfer);
 
@@ -310,16 +1507,19 @@ bool ToxTransferManager::pause(ObjectHandle transfer) {
 
 bool ToxTransferManager::setFileI(ObjectHandle transfer, std::unique_ptr<File2I>&& new_file) {
 	if (!static_cast<bool>(transfer)) {
-		std::cerr << "TTM error: setFileI() transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer\n";
+		TOX_LOG_ERROR("TTM") << "setFileI() transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer";
 		return false;
 	}
 
 	if (!new_file->isGood()) {
-		std::cerr << "TTM error: failed setting new_file_impl!\n";
+		TOX_LOG_ERROR("TTM") << "failed setting new_file_impl!";
 		return false;
 	}
 
+	// not known to the backend, stays open
 	transfer.emplace_or_replace<Components::TFTFile2>(std::move(new_file));
+	transfer.remove<Components::TFTFileClosed, ObjComp::Tox::ReceivedRanges>();
+	transfer.remove<Components::TFTReadAhead>();
 
 	_os.throwEventUpdate(transfer);
 
@@ -328,7 +1528,7 @@ bool ToxTransferManager::setFileI(ObjectHandle transfer, std::unique_ptr<File2I>
 
 bool ToxTransferManager::setFilePath(ObjectHandle transfer, std::string_view file_path) {
 	if (!static_cast<bool>(transfer)) {
-		std::cerr << "TTM error: setFilePath() transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer\n";
+		TOX_LOG_ERROR("TTM") << "setFilePath() transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer";
 		return false;
 	}
 
@@ -347,15 +1547,10 @@ bool ToxTransferManager::setFilePath(ObjectHandle transfer, std::string_view fil
 	transfer.emplace_or_replace<ObjComp::F::SingleInfoLocal>(full_file_path.u8string());
 	transfer.emplace_or_replace<ObjComp::Ephemeral::FilePath>(full_file_path.u8string()); // ?
 
-	// huh? we also set file2i ?
-	auto file_impl = std::make_unique<File2RWFile>(full_file_path.u8string(), file_size, true);
-	if (!file_impl->isGood()) {
-		std::cerr << "TTM error: failed opening file '" << file_path << "'!\n";
+	if (!objOpenRecvFile(transfer, full_file_path.u8string(), file_size)) {
 		return false;
 	}
 
-	transfer.emplace_or_replace<Components::TFTFile2>(std::move(file_impl));
-
 	// TODO: is this a good idea????
 	_os.throwEventUpdate(transfer);
 
@@ -364,7 +1559,7 @@ bool ToxTransferManager::setFilePath(ObjectHandle transfer, std::string_view fil
 
 bool ToxTransferManager::setFilePathDir(ObjectHandle transfer, std::string_view file_path) {
 	if (!static_cast<bool>(transfer)) {
-		std::cerr << "TTM error: setFilePathDir() transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer\n";
+		TOX_LOG_ERROR("TTM") << "setFilePathDir() transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer";
 		return false;
 	}
 
@@ -385,22 +1580,17 @@ bool ToxTransferManager::setFilePathDir(ObjectHandle transfer, std::string_view
 		full_file_path += file_info.file_name;
 
 	} else {
-		std::cerr << "TTM warning: no FileInfo on transfer, using default\n";
+		TOX_LOG_WARNING("TTM") << "no FileInfo on transfer, using default";
 		full_file_path += "file_recv.bin";
 	}
 
 	transfer.emplace_or_replace<ObjComp::F::SingleInfoLocal>(full_file_path);
 	transfer.emplace_or_replace<ObjComp::Ephemeral::FilePath>(full_file_path); // ?
 
-	// huh? we also set file2i ?
-	auto file_impl = std::make_unique<File2RWFile>(full_file_path, file_size, true);
-	if (!file_impl->isGood()) {
-		std::cerr << "TTM error: failed opening file '" << file_path << "'!\n";
+	if (!objOpenRecvFile(transfer, full_file_path, file_size)) {
 		return false;
 	}
 
-	transfer.emplace_or_replace<Components::TFTFile2>(std::move(file_impl));
-
 	// TODO: is this a good idea???? - no lol, it was not
 	_os.throwEventUpdate(transfer);
 
@@ -409,17 +1599,22 @@ bool ToxTransferManager::setFilePathDir(ObjectHandle transfer, std::string_view
 
 bool ToxTransferManager::accept(ObjectHandle transfer, std::string_view file_path, bool path_is_file) {
 	if (!static_cast<bool>(transfer)) {
-		std::cerr << "TTM error: accepted transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer\n";
+		TOX_LOG_ERROR("TTM") << "accepted transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer";
 		return false;
 	}
 
+	// already received (or receiving) into memory
+	if (objIsMemoryAvatar(transfer)) {
+		return acceptAvatar(transfer, file_path, path_is_file);
+	}
+
 	if (!transfer.all_of<ObjComp::Tox::TagIncomming, ObjComp::Ephemeral::ToxTransferFriend>()) {
-		std::cerr << "TTM error: accepted transfer " << entt::to_integral(transfer.entity()) << " is not a receiving transfer\n";
+		TOX_LOG_ERROR("TTM") << "accepted transfer " << entt::to_integral(transfer.entity()) << " is not a receiving transfer";
 		return false;
 	}
 
 	if (transfer.any_of<ObjComp::Ephemeral::BackendMeta, ObjComp::Ephemeral::BackendFile2>()) {
-		std::cerr << "TTM error: accepted transfer " << entt::to_integral(transfer.entity()) << " already has backend, use obj instead\n";
+		TOX_LOG_ERROR("TTM") << "accepted transfer " << entt::to_integral(transfer.entity()) << " already has backend, use obj instead";
 		return false;
 	}
 
@@ -431,27 +1626,27 @@ bool ToxTransferManager::accept(ObjectHandle transfer, std::string_view file_pat
 	}
 
 	if (transfer.any_of<Components::TFTFile2>()) {
-		std::cerr << "TTM warning: overwriting existing file_impl " << entt::to_integral(transfer.entity()) << "\n";
+		TOX_LOG_WARNING("TTM") << "overwriting existing file_impl " << entt::to_integral(transfer.entity());
 	}
 
 	if (path_is_file) {
 		if (!setFilePath(transfer, file_path)) {
-			std::cerr << "TTM error: accepted transfer " << entt::to_integral(transfer.entity()) << " failed setting path\n";
+			TOX_LOG_ERROR("TTM") << "accepted transfer " << entt::to_integral(transfer.entity()) << " failed setting path";
 			return false;
 		}
 	} else {
 		if (!setFilePathDir(transfer, file_path)) {
-			std::cerr << "TTM error: accepted transfer " << entt::to_integral(transfer.entity()) << " failed setting path dir\n";
+			TOX_LOG_ERROR("TTM") << "accepted transfer " << entt::to_integral(transfer.entity()) << " failed setting path dir";
 			return false;
 		}
 	}
 
 	if (!resume(transfer)) {
-		std::cerr << "TTM error: accepted transfer " << entt::to_integral(transfer.entity()) << " failed to resume\n";
+		TOX_LOG_ERROR("TTM") << "accepted transfer " << entt::to_integral(transfer.entity()) << " failed to resume";
 		return false;
 	}
 
-	std::cout << "TTM info: accepted " << entt::to_integral(transfer.entity()) << ", saving to " << file_path << "\n";
+	TOX_LOG_INFO("TTM") << "accepted " << entt::to_integral(transfer.entity());
 
 	// setFilePathDir() and resume() throw events
 
@@ -460,45 +1655,537 @@ bool ToxTransferManager::accept(ObjectHandle transfer, std::string_view file_pat
 
 bool ToxTransferManager::acceptObj(ObjectHandle transfer) {
 	if (!static_cast<bool>(transfer)) {
-		std::cerr << "TTM error: accepted transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer\n";
+		TOX_LOG_ERROR("TTM") << "accepted transfer " << entt::to_integral(transfer.entity()) << " is not a valid transfer";
 		return false;
 	}
 
 	if (!transfer.all_of<ObjComp::Tox::TagIncomming, ObjComp::Ephemeral::ToxTransferFriend>()) {
-		std::cerr << "TTM error: accepted transfer " << entt::to_integral(transfer.entity()) << " is not a receiving transfer\n";
+		TOX_LOG_ERROR("TTM") << "accepted transfer " << entt::to_integral(transfer.entity()) << " is not a receiving transfer";
 		return false;
 	}
 
 	if (transfer.any_of<Components::TFTFile2>()) {
-		std::cerr << "TTM error: existing file_impl " << entt::to_integral(transfer.entity()) << "\n";
+		TOX_LOG_ERROR("TTM") << "existing file_impl " << entt::to_integral(transfer.entity());
 		return false;
 	}
 
 	if (!transfer.all_of<ObjComp::Ephemeral::BackendFile2>()) {
-		std::cerr << "TTM error: transfer " << entt::to_integral(transfer.entity()) << " missing BackendFile2\n";
+		TOX_LOG_ERROR("TTM") << "transfer " << entt::to_integral(transfer.entity()) << " missing BackendFile2";
 		return false;
 	}
 
 	if (!resume(transfer)) {
-		std::cerr << "TTM error: accepted transfer " << entt::to_integral(transfer.entity()) << " failed to resume\n";
+		TOX_LOG_ERROR("TTM") << "accepted transfer " << entt::to_integral(transfer.entity()) << " failed to resume";
 		return false;
 	}
 
-	std::cout << "TTM info: accepted " << entt::to_integral(transfer.entity()) << "\n";
+	TOX_LOG_INFO("TTM") << "accepted " << entt::to_integral(transfer.entity());
 
 	// resume() throws events (bad lol)
 
 	return true;
 }
 
+void ToxTransferManager::objIndexHaveAll(ObjectHandle o) {
+	if (!o.all_of<ObjComp::Tox::FileID, ObjComp::F::TagLocalHaveAll>()) {
+		return;
+	}
+
+	auto& list = _have_all_index[o.get<ObjComp::Tox::FileID>().id.data];
+	if (std::find(list.cbegin(), list.cend(), o.entity()) == list.cend()) {
+		list.push_back(o.entity());
+	}
+}
+
+ObjectHandle ToxTransferManager::findHaveAll(const Contact4 c, const std::vector<uint8_t>& file_id, const uint64_t file_size) {
+	std::array<uint8_t, 32> id {};
+	if (file_id.size() != id.size()) {
+		return {};
+	}
+	std::copy(file_id.cbegin(), file_id.cend(), id.begin());
+
+	const auto it = _have_all_index.find(id);
+	if (it == _have_all_index.end()) {
+		return {};
+	}
+
+	auto& reg = _os.registry();
+	auto& list = it->second;
+
+	ObjectHandle res;
+	for (size_t i = 0; i < list.size();) {
+		const Object ov = list[i];
+
+		// drop the ones that stopped being complete
+		if (
+			!reg.valid(ov) ||
+			!reg.all_of<ObjComp::F::TagLocalHaveAll, ObjComp::Tox::FileID>(ov) ||
+			reg.get<ObjComp::Tox::FileID>(ov).id.data != id
+		) {
+			list[i] = list.back();
+			list.pop_back();
+			continue;
+		}
+		i++;
+
+		if (static_cast<bool>(res)) {
+			continue; // only pruning
+		}
+
+		// the FileID alone says nothing about the content. only objects
+		// the contact already knows about, or content verified against the id,
+		// otherwise anyone could probe what we have (or sent to others)
+		const auto* ch = reg.try_get<ObjComp::Tox::ContentHash>(ov);
+		const auto* oc = reg.try_get<ObjComp::Ephemeral::ToxContact>(ov);
+		if ((ch == nullptr || !ch->file_id_match) && (oc == nullptr || oc->c.entity() != c)) {
+			continue;
+		}
+
+		const auto* si = reg.try_get<ObjComp::F::SingleInfo>(ov);
+		if (si == nullptr || si->file_size != file_size) {
+			continue;
+		}
+
+		res = {reg, ov};
+	}
+
+	if (list.empty()) {
+		_have_all_index.erase(it);
+	}
+
+	return res;
+}
+
+bool ToxTransferManager::objIsMemoryAvatar(ObjectHandle o) const {
+	const auto* kind = o.try_get<ObjComp::Tox::FileKind>();
+	const auto* backend = o.try_get<ObjComp::Ephemeral::BackendFile2>();
+	return
+		kind != nullptr && kind->kind == TOX_FILE_KIND_AVATAR &&
+		backend != nullptr && backend->ptr == &_ftm &&
+		o.all_of<ObjComp::Ephemeral::ToxMemoryFile>()
+	;
+}
+
+bool ToxTransferManager::acceptAvatar(ObjectHandle o, std::string_view file_path, bool path_is_file) {
+	std::filesystem::path full_file_path{file_path};
+	if (!path_is_file) {
+		if (const auto* si = o.try_get<ObjComp::F::SingleInfo>(); si != nullptr && !si->file_name.empty()) {
+			full_file_path /= si->file_name;
+		} else {
+			full_file_path /= "avatar.bin";
+		}
+	}
+	if (auto parent_path = full_file_path.parent_path(); !parent_path.empty()) {
+		std::filesystem::create_directories(parent_path);
+	}
+
+	o.emplace_or_replace<ObjComp::F::SingleInfoLocal>(full_file_path.u8string());
+	o.emplace_or_replace<ObjComp::Ephemeral::FilePath>(full_file_path.u8string()); // ?
+	o.emplace_or_replace<Components::TFTAvatarSave>();
+
+	// otherwise finishRecv() writes it
+	if (o.all_of<ObjComp::F::TagLocalHaveAll>() && !objAvatarToDisk(o)) {
+		return false;
+	}
+
+	TOX_LOG_INFO("TTM") << "accepted avatar " << entt::to_integral(o.entity());
+
+	_os.throwEventUpdate(o);
+
+	return true;
+}
+
+bool ToxTransferManager::objAvatarToDisk(ObjectHandle o) {
+	const auto* sil = o.try_get<ObjComp::F::SingleInfoLocal>();
+	const auto* mem_ptr = o.try_get<ObjComp::Ephemeral::ToxMemoryFile>();
+	if (sil == nullptr || sil->file_path.empty() || mem_ptr == nullptr || !mem_ptr->data) {
+		return false;
+	}
+
+	{ // small, one write
+		File2RWFile file{sil->file_path, int64_t(mem_ptr->data->size()), true};
+		if (!file.isGood() || !file.write(ByteSpan{*mem_ptr->data}, 0)) {
+			// stays in memory
+			TOX_LOG_ERROR("TTM") << "failed writing avatar e:" << entt::to_integral(o.entity()) << " to '" << sil->file_path << "'";
+			return false;
+		}
+	}
+
+	// now a regular file object, the cache keeps the data
+	const auto& id_data = o.get<ObjComp::Tox::FileID>().id.data;
+	o.emplace_or_replace<ObjComp::ID>(std::vector<uint8_t>(id_data.cbegin(), id_data.cend()));
+	o.emplace_or_replace<ObjComp::Ephemeral::BackendMeta>(&_ftb);
+	o.emplace_or_replace<ObjComp::Ephemeral::BackendFile2>(&_ftb);
+	o.remove<ObjComp::Ephemeral::ToxMemoryFile, Components::TFTFile2, Components::TFTAvatarSave>();
+
+	TOX_LOG_DEBUG("TTM") << "wrote avatar e:" << entt::to_integral(o.entity()) << " to disk";
+
+	return true;
+}
+
+void ToxTransferManager::objReleaseAvatar(const Contact4 c, ObjectHandle o) {
+	const auto it = _avatar_objects.find(c);
+	if (it != _avatar_objects.end()) {
+		ObjectHandle prev {_os.registry(), it->second};
+		// the client did not want it on disk, no one else will
+		if (prev.valid() && prev.entity() != o.entity() && objIsMemoryAvatar(prev)) {
+			if (const auto* ttf = prev.try_get<ObjComp::Ephemeral::ToxTransferFriend>(); ttf != nullptr) {
+				_t.toxFileControl(ttf->friend_number, ttf->transfer_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
+				toxTransferCleanup(prev);
+			}
+
+			TOX_LOG_DEBUG("TTM") << "releasing superseded avatar e:" << entt::to_integral(prev.entity());
+
+			_os.throwEventDestroy(prev);
+			prev.destroy();
+		}
+	}
+
+	_avatar_objects[c] = o.entity();
+}
+
+void ToxTransferManager::recvAvatar(const ContactHandle4 c, const uint32_t friend_number, const uint32_t file_number, const uint64_t file_size, std::string_view file_name, const std::vector<uint8_t>& file_id) {
+	std::array<uint8_t, 32> id {};
+	if (file_id.size() == id.size()) {
+		std::copy(file_id.cbegin(), file_id.cend(), id.begin());
+	}
+
+	auto o = _os.objectHandle(_os.registry().create());
+	objReleaseAvatar(c, o);
+
+	o.emplace<ObjComp::Tox::TagIncomming>();
+	o.emplace<ObjComp::Ephemeral::ToxContact>(c);
+	o.emplace<ObjComp::Tox::FileKind>(uint64_t(TOX_FILE_KIND_AVATAR));
+	o.emplace<ObjComp::Tox::FileID>(file_id);
+	o.emplace<ObjComp::F::SingleInfo>(std::string{file_name}, file_size);
+	o.emplace<ObjComp::Ephemeral::File::TransferStats>();
+	o.emplace<ObjComp::Ephemeral::BackendFile2>(&_ftm);
+
+	if (const auto it = _avatar_cache.find(id); it != _avatar_cache.end() && it->second->size() == file_size) {
+		// seen this one before (other friend, or object gone), no need to download
+		_t.toxFileControl(friend_number, file_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
+		_stats.avatar_cache_hits++;
+
+		o.emplace<ObjComp::Ephemeral::ToxMemoryFile>(it->second);
+		o.emplace<ObjComp::F::TagLocalHaveAll>();
+
+		TOX_LOG_DEBUG("TTM") << "avatar of frd:" << friend_number << " from cache e:" << entt::to_integral(o.entity());
+
+		_os.throwEventConstruct(o);
+		return;
+	}
+
+	_stats.avatar_recvs++;
+
+	auto data = std::make_shared<std::vector<uint8_t>>();
+	data->reserve(file_size);
+	o.emplace<ObjComp::Ephemeral::ToxMemoryFile>(data);
+	// the backend hands out the same memory again
+	o.emplace<Components::TFTFile2>(std::make_shared<File2MemRW>(data)).reopenable = true;
+
+	o.emplace<ObjComp::Ephemeral::File::TagTransferPaused>();
+	o.emplace<ObjComp::Ephemeral::ToxTransferFriend>(friend_number, file_number);
+
+	toxFriendLookupAdd(o);
+
+	_os.throwEventConstruct(o);
+
+	// auto accept
+	if (!resume(o)) {
+		TOX_LOG_ERROR("TTM") << "failed to accept avatar of frd:" << friend_number << " fnb:" << file_number;
+	}
+}
+
+void ToxTransferManager::avatarCacheAdd(const std::array<uint8_t, 32>& id, std::shared_ptr<std::vector<uint8_t>> data) {
+	if (!data || data->size() > _avatar_cache_max_bytes || _avatar_cache.count(id)) {
+		return;
+	}
+
+	_avatar_cache_bytes += data->size();
+	_avatar_cache.emplace(id, std::move(data));
+	_avatar_cache_order.push_back(id);
+
+	while (_avatar_cache_bytes > _avatar_cache_max_bytes && !_avatar_cache_order.empty()) {
+		const auto it = _avatar_cache.find(_avatar_cache_order.front());
+		_avatar_cache_order.pop_front();
+		if (it != _avatar_cache.end()) {
+			_avatar_cache_bytes -= it->second->size();
+			_avatar_cache.erase(it);
+		}
+	}
+}
+
+void ToxTransferManager::objSendOrQueue(ObjectHandle o, const Contact4 c) {
+	const auto& cr = _cs.registry();
+
+	const auto* tfe_ptr = cr.try_get<Contact::Components::ToxFriendEphemeral>(c);
+	const auto* cs_ptr = cr.try_get<Contact::Components::ConnectionState>(c);
+	const bool online = tfe_ptr != nullptr && cs_ptr != nullptr && cs_ptr->state != Contact::Components::ConnectionState::disconnected;
+
+	auto queue_it = _send_queue.find(c);
+	const bool queue_empty = queue_it == _send_queue.end() || queue_it->second.empty();
+
+	// keep the order
+	if (online && queue_empty && (_max_active_sends == 0 || activeSendCount(tfe_ptr->friend_number) < _max_active_sends)) {
+		bool retry {false};
+		if (objSendOffer(o, tfe_ptr->friend_number, retry) || !retry) {
+			return;
+		}
+	}
+
+	TOX_LOG_DEBUG("TTM") << "queued e:" << entt::to_integral(o.entity()) << " for c:" << entt::to_integral(c);
+
+	o.emplace_or_replace<ObjComp::Ephemeral::ToxTransferQueued>(_tcm.tickClock().now());
+	_send_queue[c].push_back(o.entity());
+}
+
+bool ToxTransferManager::objSendOffer(ObjectHandle o, const uint32_t friend_number, bool& retry) {
+	const auto& info = o.get<ObjComp::F::SingleInfo>();
+	const auto& file_id = o.get<ObjComp::Tox::FileID>().id.data;
+
+	const auto&& [transfer_id, err] = _t.toxFileSend(
+		friend_number,
+		o.get<ObjComp::Tox::FileKind>().kind,
+		info.file_size,
+		{file_id.cbegin(), file_id.cend()},
+		info.file_name
+	);
+	if (err != TOX_ERR_FILE_SEND_OK) {
+		retry = err == TOX_ERR_FILE_SEND_FRIEND_NOT_CONNECTED || err == TOX_ERR_FILE_SEND_TOO_MANY;
+		if (!retry) {
+			TOX_LOG_ERROR("TTM") << "failed to send e:" << entt::to_integral(o.entity()) << " frd:" << friend_number << " err:" << err;
+		}
+		return false;
+	}
+	assert(transfer_id.has_value());
+
+	o.remove<ObjComp::Ephemeral::ToxTransferQueued>();
+	o.emplace_or_replace<ObjComp::Ephemeral::ToxTransferFriend>(friend_number, transfer_id.value());
+	// TODO: add tag signifying init sent status?
+
+	// offered again (eg after a disconnect), toxcore starts over.
+	// a seek by the receiver is picked up with the first chunk request
+	o.get_or_emplace<ObjComp::Ephemeral::File::TransferStats>().total_up = 0;
+	o.remove<Components::TFTRateWindow>();
+
+	toxFriendLookupAdd(o);
+
+	return true;
+}
+
+size_t ToxTransferManager::activeSendCount(const uint32_t friend_number) const {
+	const auto it = _friend_transfers.find(friend_number);
+	if (it == _friend_transfers.end()) {
+		return 0;
+	}
+
+	return std::count_if(it->second.cbegin(), it->second.cend(), [this](const Object ov) {
+		return _os.registry().all_of<ObjComp::Tox::TagOutgoing>(ov);
+	});
+}
+
+size_t ToxTransferManager::sendQueueSize(const Contact4 c) const {
+	const auto it = _send_queue.find(c);
+	if (it == _send_queue.end()) {
+		return 0;
+	}
+	return it->second.size();
+}
+
+void ToxTransferManager::scheduleTransfers(void) {
+	if (_max_running_transfers == 0 && _max_running_transfers_friend == 0) {
+		return;
+	}
+
+	const uint64_t ts_now = _tcm.tickClock().now();
+	if (ts_now - _last_schedule_ts < 500) {
+		return;
+	}
+	_last_schedule_ts = ts_now;
+
+	struct Candidate {
+		Object o;
+		uint32_t friend_number;
+		int32_t priority;
+		uint64_t remaining;
+		bool running;
+		size_t friend_rank {0};
+	};
+
+	// running, or paused by us
+	std::vector<Candidate> candidates;
+	for (const auto& [ov, ttf] : _os.registry().view<ObjComp::Ephemeral::ToxTransferFriend>(entt::exclude<Components::TFTRemotePaused>).each()) {
+		const bool sched_paused = _os.registry().all_of<Components::TFTSchedPaused>(ov);
+		if (!sched_paused && _os.registry().all_of<ObjComp::Ephemeral::File::TagTransferPaused>(ov)) {
+			continue; // user paused or not accepted yet
+		}
+
+		Candidate cand {ov, ttf.friend_number, 0, UINT64_MAX, !sched_paused};
+
+		if (const auto* prio_ptr = _os.registry().try_get<ObjComp::Ephemeral::ToxTransferPriority>(ov); prio_ptr != nullptr) {
+			cand.priority = prio_ptr->priority;
+		}
+
+		if (const auto* si = _os.registry().try_get<ObjComp::F::SingleInfo>(ov); si != nullptr) {
+			uint64_t done {0};
+			if (const auto* tstats = _os.registry().try_get<ObjComp::Ephemeral::File::TransferStats>(ov); tstats != nullptr) {
+				done = _os.registry().all_of<ObjComp::Tox::TagOutgoing>(ov) ? tstats->total_up : tstats->total_down;
+			}
+			if (si->file_size != UINT64_MAX) { // streams go last
+				cand.remaining = si->file_size > done ? si->file_size - done : 0;
+			}
+		}
+
+		candidates.push_back(cand);
+	}
+
+	if (candidates.empty()) {
+		return;
+	}
+
+	// per friend order: running ones keep their slot (no flapping, big ones
+	// dont starve), new ones smallest first
+	std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+		if (a.priority != b.priority) {
+			return a.priority > b.priority;
+		}
+		if (a.running != b.running) {
+			return a.running;
+		}
+		return a.remaining < b.remaining;
+	});
+
+	{ // rank within the friend
+		entt::dense_map<uint32_t, size_t> next_rank;
+		for (auto& cand : candidates) {
+			cand.friend_rank = next_rank[cand.friend_number]++;
+		}
+	}
+
+	// fair share: every friends first transfer before anyone's second,
+	// new admissions rotate through the friends
+	const uint32_t first_friend = _schedule_next_friend;
+	std::stable_sort(candidates.begin(), candidates.end(), [first_friend](const Candidate& a, const Candidate& b) {
+		if (a.priority != b.priority) {
+			return a.priority > b.priority;
+		}
+		if (a.friend_rank != b.friend_rank) {
+			return a.friend_rank < b.friend_rank;
+		}
+		if (a.running != b.running) {
+			return a.running;
+		}
+		return uint32_t(a.friend_number - first_friend) < uint32_t(b.friend_number - first_friend);
+	});
+
+	size_t running_total {0};
+	entt::dense_map<uint32_t, size_t> running_friend;
+	std::vector<Object> to_pause;
+	std::vector<Object> to_resume;
+	for (const auto& cand : candidates) {
+		auto& friend_count = running_friend[cand.friend_number];
+		const bool admit =
+			(_max_running_transfers == 0 || running_total < _max_running_transfers) &&
+			(_max_running_transfers_friend == 0 || friend_count < _max_running_transfers_friend)
+		;
+
+		if (admit) {
+			running_total++;
+			friend_count++;
+			if (!cand.running) {
+				to_resume.push_back(cand.o);
+				_schedule_next_friend = cand.friend_number + 1;
+			}
+		} else if (cand.running) {
+			to_pause.push_back(cand.o);
+		}
+	}
+
+	// pause first, so the link is free for the resumed ones
+	for (const auto ov : to_pause) {
+		ObjectHandle o {_os.registry(), ov};
+		if (!o.valid() || !o.all_of<ObjComp::Ephemeral::ToxTransferFriend>()) {
+			continue;
+		}
+		if (pause(o)) {
+			o.remove<Components::TFTLocalPaused>();
+			o.emplace_or_replace<Components::TFTSchedPaused>();
+		}
+	}
+
+	for (const auto ov : to_resume) {
+		ObjectHandle o {_os.registry(), ov};
+		if (!o.valid() || !o.all_of<ObjComp::Ephemeral::ToxTransferFriend>()) {
+			continue;
+		}
+		resume(o);
+	}
+}
+
+void ToxTransferManager::dispatchSendQueue(void) {
+	if (_send_queue.empty()) {
+		return;
+	}
+
+	const auto& cr = _cs.registry();
+
+	std::vector<Contact4> emptied;
+	std::vector<ObjectHandle> offered;
+	for (auto& [c, queue] : _send_queue) {
+		if (!cr.valid(c)) {
+			emptied.push_back(c);
+			continue;
+		}
+
+		const auto* tfe_ptr = cr.try_get<Contact::Components::ToxFriendEphemeral>(c);
+		const auto* cs_ptr = cr.try_get<Contact::Components::ConnectionState>(c);
+		if (tfe_ptr == nullptr || cs_ptr == nullptr || cs_ptr->state == Contact::Components::ConnectionState::disconnected) {
+			continue;
+		}
+
+		size_t active = activeSendCount(tfe_ptr->friend_number);
+		while (!queue.empty() && (_max_active_sends == 0 || active < _max_active_sends)) {
+			ObjectHandle o {_os.registry(), queue.front()};
+			if (!o.valid() || !o.all_of<ObjComp::Ephemeral::ToxTransferQueued>()) {
+				queue.pop_front();
+				continue; // gone, or sent by other means
+			}
+
+			bool retry {false};
+			if (!objSendOffer(o, tfe_ptr->friend_number, retry)) {
+				if (retry) {
+					break; // try again next iterate
+				}
+				o.remove<ObjComp::Ephemeral::ToxTransferQueued>();
+			} else {
+				active++;
+			}
+
+			queue.pop_front();
+			offered.push_back(o);
+		}
+
+		if (queue.empty()) {
+			emptied.push_back(c);
+		}
+	}
+
+	for (const auto c : emptied) {
+		_send_queue.erase(c);
+	}
+
+	// event handlers might queue more
+	for (auto o : offered) {
+		_os.throwEventUpdate(o);
+	}
+}
+
 bool ToxTransferManager::sendFilePath(const Contact4 c, std::string_view file_name, std::string_view file_path) {
 	const auto& cr = _cs.registry();
 	if (
-		// TODO: add support of offline queuing
-		!cr.all_of<Contact::Components::ToxFriendEphemeral>(c) ||
+		// offline friends get queued
 		!cr.all_of<Contact::Components::ToxFriendPersistent>(c)
 	) {
-		// TODO: add support for persistent friend filesends (messages only?)
 		return false;
 	}
 
@@ -508,17 +2195,15 @@ bool ToxTransferManager::sendFilePath(const Contact4 c, std::string_view file_na
 bool ToxTransferManager::sendFileObj(const Contact4 c, ObjectHandle o) {
 	const auto& cr = _cs.registry();
 	if (
-		// TODO: add support of offline queuing
-		!cr.all_of<Contact::Components::ToxFriendEphemeral>(c) ||
+		// offline friends get queued
 		!cr.all_of<Contact::Components::ToxFriendPersistent>(c)
 	) {
-		// TODO: add support for persistent friend filesends (messages only?)
 		return false;
 	}
 
 	// needs to have:
 	// - SingleInfo
-	// - LocalHaveAll (TODO: figure out streaming?)
+	// - LocalHaveAll (streams go through toxSendStream())
 	// - Tox::FileID (defaults to obj id? rng?)
 	// - Tox::FileKind (defaults to 0(DATA) )
 	// - StorageBackendIFile2
@@ -531,16 +2216,17 @@ bool ToxTransferManager::sendFileObj(const Contact4 c, ObjectHandle o) {
 			ObjComp::Ephemeral::BackendFile2
 		>()
 	) {
-		std::cerr << "TTM error: tried sending incomplete object\n";
+		TOX_LOG_ERROR("TTM") << "tried sending incomplete object";
 		return false;
 	}
 
 	// get current time unix epoch utc
-	uint64_t ts = getTimeMS();
+	// not part of an event batch
+	uint64_t ts = _tcm.tickClock().nowPrecise();
 
 	const auto c_self = cr.get<Contact::Components::Self>(c).self;
 	if (!cr.valid(c_self)) {
-		std::cerr << "TTM error: failed to get self!\n";
+		TOX_LOG_ERROR("TTM") << "failed to get self!";
 		return false;
 	}
 
@@ -556,8 +2242,10 @@ bool ToxTransferManager::sendFileObj(const Contact4 c, ObjectHandle o) {
 	o.emplace_or_replace<ObjComp::Ephemeral::ToxContact>(_cs.contactHandle(c));
 
 	if (!o.all_of<ObjComp::Tox::FileID>()) {
-		// use id if set, otherwise random
-		if (o.all_of<ObjComp::ID>()) {
+		// use the content hash if known, then id if set, otherwise random
+		if (const auto* ch = o.try_get<ObjComp::Tox::ContentHash>(); ch != nullptr) {
+			o.emplace<ObjComp::Tox::FileID>(std::vector<uint8_t>{ch->hash.cbegin(), ch->hash.cend()});
+		} else if (o.all_of<ObjComp::ID>()) {
 			o.emplace<ObjComp::Tox::FileID>(
 				o.get<ObjComp::ID>().v
 			);
@@ -573,8 +2261,6 @@ bool ToxTransferManager::sendFileObj(const Contact4 c, ObjectHandle o) {
 		o.emplace<ObjComp::Tox::FileKind>();
 	}
 
-	const auto& info = o.get<ObjComp::F::SingleInfo>();
-
 	o.emplace<ObjComp::Tox::TagOutgoing>();
 	o.emplace<ObjComp::Ephemeral::File::TransferStats>();
 
@@ -588,25 +2274,11 @@ bool ToxTransferManager::sendFileObj(const Contact4 c, ObjectHandle o) {
 		msg.emplace<Message::Components::ContactFrom>(c_self);
 		msg.emplace<Message::Components::Timestamp>(ts); // reactive?
 		msg.emplace<Message::Components::Read>(ts);
-		msg.emplace<Message::Components::ReceivedBy>().ts.try_emplace(c_self, ts);
-		msg.emplace<Message::Components::MessageFileObject>(o);
-	}
-
-	const auto friend_number = cr.get<Contact::Components::ToxFriendEphemeral>(c).friend_number;
-	const auto&& [transfer_id, err] = _t.toxFileSend(
-		friend_number,
-		o.get<ObjComp::Tox::FileKind>().kind,
-		info.file_size,
-		{o.get<ObjComp::Tox::FileID>().id.data.cbegin(), o.get<ObjComp::Tox::FileID>().id.data.cend()},
-		info.file_name
-	);
-	if (err == TOX_ERR_FILE_SEND_OK) {
-		assert(transfer_id.has_value());
-		o.emplace<ObjComp::Ephemeral::ToxTransferFriend>(friend_number, transfer_id.value());
-		// TODO: add tag signifying init sent status?
+		msg.emplace<Message::Components::ReceivedBy>().ts.try_emplace(c_self, ts);
+		msg.emplace<Message::Components::MessageFileObject>(o);
+	}
 
-		toxFriendLookupAdd(o);
-	} // else queue?
+	objSendOrQueue(o, c);
 
 	_os.throwEventUpdate(o);
 
@@ -617,13 +2289,27 @@ bool ToxTransferManager::sendFileObj(const Contact4 c, ObjectHandle o) {
 	return true;
 }
 
+bool ToxTransferManager::onEvent(const ObjectStore::Events::ObjectConstruct& e) {
+	objIndexHaveAll(e.e);
+	// eg loaded with persisted ranges
+	objIndexResumable(e.e);
+
+	return false;
+}
+
 bool ToxTransferManager::onEvent(const ObjectStore::Events::ObjectUpdate& e) {
+	objIndexHaveAll(e.e);
+
 	if (_in_obj_update_event) {
 		return false;
 	}
 
 	_in_obj_update_event = true;
-	if (e.e.all_of<ObjComp::Ephemeral::File::ActionTransferAccept, ObjComp::Ephemeral::ToxTransferFriend>()) {
+	// memory avatars can be accepted even after they are complete
+	if (
+		e.e.all_of<ObjComp::Ephemeral::File::ActionTransferAccept>() &&
+		(e.e.all_of<ObjComp::Ephemeral::ToxTransferFriend>() || objIsMemoryAvatar(e.e))
+	) {
 		accept(
 			e.e,
 			e.e.get<ObjComp::Ephemeral::File::ActionTransferAccept>().save_to_path,
@@ -647,6 +2333,38 @@ bool ToxTransferManager::onEvent(const ObjectStore::Events::ObjectDestory& e) {
 		toxFriendLookupRemove(e.e);
 	}
 
+	if (const auto* tc = e.e.try_get<ObjComp::Ephemeral::ToxContact>(); tc != nullptr) {
+		if (const auto it = _avatar_objects.find(tc->c.entity()); it != _avatar_objects.end() && it->second == e.e.entity()) {
+			_avatar_objects.erase(it);
+		}
+	}
+
+	if (const auto* fid = e.e.try_get<ObjComp::Tox::FileID>(); fid != nullptr) {
+		if (const auto it = _have_all_index.find(fid->id.data); it != _have_all_index.end()) {
+			auto& list = it->second;
+			const auto list_it = std::find(list.begin(), list.end(), e.e.entity());
+			if (list_it != list.end()) {
+				*list_it = list.back();
+				list.pop_back();
+			}
+			if (list.empty()) {
+				_have_all_index.erase(it);
+			}
+		}
+
+		if (const auto it = _resumable_index.find(fid->id.data); it != _resumable_index.end()) {
+			auto& list = it->second;
+			const auto list_it = std::find(list.begin(), list.end(), e.e.entity());
+			if (list_it != list.end()) {
+				*list_it = list.back();
+				list.pop_back();
+			}
+			if (list.empty()) {
+				_resumable_index.erase(it);
+			}
+		}
+	}
+
 	return false;
 }
 
@@ -658,23 +2376,37 @@ bool ToxTransferManager::onToxEvent(const Tox_Event_Friend_Connection_Status* e)
 		auto c = _tcm.getContactFriend(friend_number);
 
 		std::vector<Object> to_destory;
-		_os.registry().view<ObjComp::Ephemeral::ToxTransferFriend>().each([&](const Object ov, const auto& ttf) {
-			if (ttf.friend_number == friend_number) {
-				to_destory.push_back(ov);
-				std::cerr << "TTM warning: friend disconnected, forcefully removing e:" << entt::to_integral(ov) << " frd:" << friend_number << " fnb:" << ttf.transfer_number << "\n";
-			}
-		});
+		if (const auto it = _friend_transfers.find(friend_number); it != _friend_transfers.end()) {
+			// cleanup modifies the list
+			to_destory = it->second;
+		}
 
 		for (const auto ov : to_destory) {
 			ObjectHandle o {_os.registry(), ov};
+			if (!o.valid() || !o.all_of<ObjComp::Ephemeral::ToxTransferFriend>()) {
+				continue; // removed by an event handler of a previous one
+			}
+
+			TOX_LOG_WARNING("TTM") << "friend disconnected, forcefully removing e:" << entt::to_integral(ov) << " frd:" << friend_number << " fnb:" << o.get<ObjComp::Ephemeral::ToxTransferFriend>().transfer_number;
 
-			// update lookup table
-			toxFriendLookupRemove(o);
+			// keep what we got
+			objFlushWriteBehind(o);
 
-			o.remove<ObjComp::Ephemeral::ToxTransferFriend, Components::TFTFile2>();
+			// update lookup table and free resources
+			toxTransferCleanup(o);
 
 			o.emplace_or_replace<ObjComp::Ephemeral::File::TagTransferPaused>();
 
+			// offer again once back online, the receiver can seek.
+			// streams can not be sent again
+			if (
+				o.all_of<ObjComp::Tox::TagOutgoing>() && static_cast<bool>(c) &&
+				(!o.all_of<ObjComp::F::SingleInfo>() || o.get<ObjComp::F::SingleInfo>().file_size != UINT64_MAX)
+			) {
+				o.emplace_or_replace<ObjComp::Ephemeral::ToxTransferQueued>(_tcm.tickClock().now());
+				_send_queue[c].push_back(ov);
+			}
+
 			//_rmm.throwEventUpdate(*reg_ptr, ent);
 			_os.throwEventUpdate(ov);
 		}
@@ -700,18 +2432,12 @@ bool ToxTransferManager::onToxEvent(const Tox_Event_File_Recv* e) {
 	}
 
 	// making sure, we dont have a dup
-	ObjectHandle o {};
-	_os.registry().view<ObjComp::Tox::TagIncomming, ObjComp::Ephemeral::ToxTransferFriend>().each([&](Object ov, const ObjComp::Ephemeral::ToxTransferFriend& ttf) {
-		if (ttf.friend_number == friend_number && ttf.transfer_number == file_number) {
-			o = {_os.registry(), ov};
-		}
-	});
+	ObjectHandle o = toxFriendLookupReceiving(friend_number, file_number);
 	if (static_cast<bool>(o)) {
-		std::cerr << "TTM error: existing file transfer frd:" << friend_number << " fnb:" << file_number << "\n";
+		TOX_LOG_ERROR("TTM") << "existing file transfer frd:" << friend_number << " fnb:" << file_number;
 		// TODO: hard error
 		return false;
 	}
-	assert(!_friend_receiving_lookup.count((uint64_t(friend_number) << 32) | file_number));
 
 	// TODO: also check for file id
 
@@ -720,12 +2446,61 @@ bool ToxTransferManager::onToxEvent(const Tox_Event_File_Recv* e) {
 	if (!f_id_opt.has_value()) {
 		// very unfortuante, toxcore already forgot about the transfer we are handling
 		// TODO: make sure we exit gracefully here
-		std::cerr << "TTM error: querying for fileid failed, toxcore already forgot. frd:" << friend_number << " fnb:" << file_number << "\n";
+		TOX_LOG_ERROR("TTM") << "querying for fileid failed, toxcore already forgot. frd:" << friend_number << " fnb:" << file_number;
 		return false;
 	}
 
+	// already have it, skip the download
+	if (auto ho = findHaveAll(c, f_id_opt.value(), file_size); static_cast<bool>(ho)) {
+		const auto* ho_contact = ho.try_get<ObjComp::Ephemeral::ToxContact>();
+		// other kinds (avatars) are always tied to the contact
+		if (file_kind == 0 || (ho_contact != nullptr && ho_contact->c.entity() == c.entity())) {
+			TOX_LOG_INFO("TTM") << "already have e:" << entt::to_integral(ho.entity()) << " offered by frd:" << friend_number << " fnb:" << file_number << ", canceling";
+
+			_t.toxFileControl(friend_number, file_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
+
+			_stats.dedupe_hits++;
+			_stats.dedupe_bytes_saved += file_size;
+
+			if (file_kind == 0) {
+				const uint64_t ts = _tcm.tickClock().now();
+				auto self_c = _cs.registry().get<Contact::Components::Self>(c).self;
+
+				Message3Handle msg {*reg_ptr, reg_ptr->create()};
+				msg.emplace<Message::Components::ContactTo>(self_c);
+				msg.emplace<Message::Components::ContactFrom>(c);
+				msg.emplace<Message::Components::Timestamp>(ts);
+				msg.emplace<Message::Components::TagUnread>();
+				{
+					auto& rb = msg.emplace<Message::Components::ReceivedBy>().ts;
+					rb.try_emplace(c, ts);
+					rb.try_emplace(self_c, ts); // complete
+				}
+				msg.emplace<Message::Components::MessageFileObject>(ho);
+
+				_rmm.throwEventConstruct(msg);
+			}
+
+			return true;
+		}
+	}
+
+	// continue an interrupted transfer of the same file
+	if (auto ro = findResumableRecv(c, f_id_opt.value(), file_size); static_cast<bool>(ro)) {
+		if (!resumeRecv(ro, friend_number, file_number)) {
+			TOX_LOG_ERROR("TTM") << "failed to resume e:" << entt::to_integral(ro.entity()) << " frd:" << friend_number << " fnb:" << file_number;
+		}
+		return true;
+	}
+
+	// size 0 means no avatar, left to the generic path
+	if (file_kind == TOX_FILE_KIND_AVATAR && file_size != 0 && file_size <= _avatar_max_size) {
+		recvAvatar(c, friend_number, file_number, file_size, file_name, f_id_opt.value());
+		return true;
+	}
+
 	// get current time unix epoch utc
-	uint64_t ts = getTimeMS();
+	uint64_t ts = _tcm.tickClock().now();
 
 	const auto& cr = _cs.registry();
 
@@ -796,34 +2571,38 @@ bool ToxTransferManager::onToxEvent(const Tox_Event_File_Recv_Control* e) {
 	}
 
 	if (!static_cast<bool>(o)) {
-		std::cerr << "TMM waring: control for unk ft\n";
+		TOX_LOG_WARNING("TTM") << "control for unk ft";
 		return false; // shrug, we don't know about it, might be someone else's
 	}
 
 	if (control == TOX_FILE_CONTROL_CANCEL) {
-		std::cerr << "TTM: friend transfer canceled frd:" << friend_number << " fnb:" << file_number << "\n";
+		TOX_LOG_INFO("TTM") << "friend transfer canceled frd:" << friend_number << " fnb:" << file_number;
 
-		// update lookup table
-		toxFriendLookupRemove(o);
+		// keep what we got
+		objFlushWriteBehind(o);
 
-		o.remove<
-			ObjComp::Ephemeral::ToxTransferFriend,
-			Components::TFTFile2
-		>();
+		// update lookup table and free resources
+		toxTransferCleanup(o);
 
 		// TODO: canceled tag with reason??
 
 		//_rmm.throwEventUpdate(transfer);
 		_os.throwEventUpdate(o);
 	} else if (control == TOX_FILE_CONTROL_PAUSE) {
-		std::cerr << "TTM: friend transfer paused frd:" << friend_number << " fnb:" << file_number << "\n";
-		// TODO: add distinction between local and remote pause
+		TOX_LOG_INFO("TTM") << "friend transfer paused frd:" << friend_number << " fnb:" << file_number;
+		o.emplace_or_replace<Components::TFTRemotePaused>();
 		o.emplace_or_replace<ObjComp::Ephemeral::File::TagTransferPaused>();
+		objFlushWriteBehind(o);
 		//_rmm.throwEventUpdate(transfer);
 		_os.throwEventUpdate(o);
 	} else if (control == TOX_FILE_CONTROL_RESUME) {
-		std::cerr << "TTM: friend transfer resumed frd:" << friend_number << " fnb:" << file_number << "\n";
-		o.remove<ObjComp::Ephemeral::File::TagTransferPaused>();
+		TOX_LOG_INFO("TTM") << "friend transfer resumed frd:" << friend_number << " fnb:" << file_number;
+		o.remove<Components::TFTRemotePaused>();
+		// (also the accept of an outgoing offer)
+		if (!o.any_of<Components::TFTLocalPaused, Components::TFTSchedPaused>()) {
+			o.remove<ObjComp::Ephemeral::File::TagTransferPaused>();
+		}
+		objTouchActivity(o);
 		//_rmm.throwEventUpdate(transfer);
 		_os.throwEventUpdate(o);
 	}
@@ -843,68 +2622,187 @@ bool ToxTransferManager::onToxEvent(const Tox_Event_File_Recv_Chunk* e) {
 		return false; // shrug, we don't know about it, might be someone else's
 	}
 
+	objTouchActivity(o);
+
+	auto& qc = _chunk_queue.emplace_back();
+	qc.o = o.entity();
+	qc.is_request = false;
+	qc.friend_number = friend_number;
+	qc.file_number = file_number;
+	qc.position = position;
+	qc.size = data_size;
+	if (data_size != 0) {
+		// the event data does not outlive the callback
+		if (!_chunk_data_pool.empty()) {
+			qc.data = std::move(_chunk_data_pool.back());
+			_chunk_data_pool.pop_back();
+		}
+		qc.data.assign(data, data+data_size);
+	}
+
+	return true;
+}
+
+void ToxTransferManager::finishRecv(ObjectHandle o, const uint32_t friend_number) {
+	const uint64_t ts = _tcm.tickClock().now();
+
+	if (!isVerifiedComplete(o)) {
+		// stays incomplete, an offer of the same file resumes it
+		TOX_LOG_ERROR("TTM") << "finished e:" << entt::to_integral(o.entity()) << " frd:" << friend_number << ", but data is missing";
+		_stats.verify_failed++;
+		_os.throwEventUpdate(o);
+		return;
+	}
+
+	o.emplace_or_replace<ObjComp::F::TagLocalHaveAll>();
+
+	if (const auto* mem_ptr = o.try_get<ObjComp::Ephemeral::ToxMemoryFile>(); mem_ptr != nullptr && mem_ptr->data && o.all_of<ObjComp::Tox::FileID>() && !o.all_of<Components::TFTMemoryRecv>()) {
+		// avatar ids are tox_hash() (sha256) of the data, only cache what matches
+		const auto& id = o.get<ObjComp::Tox::FileID>().id.data;
+		std::array<uint8_t, crypto_hash_sha256_BYTES> hash;
+		crypto_hash_sha256(hash.data(), mem_ptr->data->data(), mem_ptr->data->size());
+		if (std::equal(hash.cbegin(), hash.cend(), id.cbegin(), id.cend())) {
+			avatarCacheAdd(id, mem_ptr->data);
+		} else {
+			TOX_LOG_DEBUG("TTM") << "avatar e:" << entt::to_integral(o.entity()) << " does not match its id, not cached";
+		}
+
+		// accepted while still receiving (logs on failure)
+		if (o.all_of<Components::TFTAvatarSave>()) {
+			objAvatarToDisk(o);
+		}
+	}
+
+	_os.throwEventUpdate(o);
+
+	// TODO: move out generic? do we want to update on EVERY chunk?
+	if (const auto* msg_ptr = o.try_get<ObjComp::Ephemeral::ToxMessage>(); msg_ptr != nullptr && static_cast<bool>(msg_ptr->m)) {
+		const auto& msg = msg_ptr->m;
+
+		// re-unread a finished transfer
+		msg.emplace_or_replace<Message::Components::TagUnread>();
+		msg.remove<Message::Components::Read>();
+
+		auto c = _tcm.getContactFriend(friend_number);
+		if (static_cast<bool>(c)) {
+			auto self_c = c.get<Contact::Components::Self>().self;
+			auto& rb = msg.get_or_emplace<Message::Components::ReceivedBy>().ts;
+			rb.try_emplace(self_c, ts); // on completion
+		}
+
+		_rmm.throwEventUpdate(msg);
+	}
+}
+
+bool ToxTransferManager::isVerifiedComplete(ObjectHandle o) const {
+	const auto* si = o.try_get<ObjComp::F::SingleInfo>();
+	if (si == nullptr || si->file_size == UINT64_MAX) {
+		return false;
+	}
+
+	if (const auto* rr = o.try_get<ObjComp::Tox::ReceivedRanges>(); rr != nullptr) {
+		if (si->file_size == 0) {
+			// nothing to write
+		} else if (rr->ranges.size() != 1 || rr->ranges.front().first != 0 || rr->ranges.front().second < si->file_size) {
+			return false;
+		}
+	} else if (si->file_size != 0 && !o.all_of<ObjComp::F::TagLocalHaveAll>()) {
+		// receive files always get ranges, without them only the tag knows
+		return false;
+	}
+
+	return true;
+}
+
+void ToxTransferManager::handleRecvChunk(ObjectHandle o, const uint32_t friend_number, const uint32_t file_number, const uint64_t position, ByteSpan data) {
+	const auto data_size = data.size;
+
 	if (data_size == 0) {
-		uint64_t ts = getTimeMS();
+		TOX_LOG_INFO("TTM") << "finished friend " << friend_number << " transfer " << file_number << ", closing";
 
-		std::cout << "TTM finished friend " << friend_number << " transfer " << file_number << ", closing\n";
+		// end of stream, now we know the size
+		if (auto* si = o.try_get<ObjComp::F::SingleInfo>(); si != nullptr && si->file_size == UINT64_MAX) {
+			si->file_size = o.get_or_emplace<ObjComp::Ephemeral::File::TransferStats>().total_down;
+		}
 
-		// update lookup table
-		toxFriendLookupRemove(o);
+		objHashFinish(o);
 
-		o.remove<
-			ObjComp::Ephemeral::ToxTransferFriend,
-			Components::TFTFile2
-		>();
+		const bool flushed = objFlushWriteBehind(o);
 
-		o.emplace_or_replace<ObjComp::F::TagLocalHaveAll>();
+		// update lookup table and free resources
+		toxTransferCleanup(o);
 
-		_os.throwEventUpdate(o);
+		if (!flushed) {
+			TOX_LOG_ERROR("TTM") << "failed writing end of f" << friend_number << " t" << file_number;
+			_os.throwEventUpdate(o);
+			return;
+		}
+
+		if (const auto* pending_ptr = o.try_get<Components::TFTIOPending>(); pending_ptr != nullptr && pending_ptr->writes != 0) {
+			// finished in processIOCompletions(), once the last write is done
+			o.emplace_or_replace<Components::TFTFinishPending>(friend_number);
+			return;
+		}
 
-		// TODO: move out generic? do we want to update on EVERY chunk?
-		if (const auto* msg_ptr = o.try_get<ObjComp::Ephemeral::ToxMessage>(); msg_ptr != nullptr && static_cast<bool>(msg_ptr->m)) {
-			const auto& msg = msg_ptr->m;
+		finishRecv(o, friend_number);
+	} else {
+		objHashChunk(o, position, data);
+
+		bool good = true;
+		if (o.all_of<Components::TFTMemoryRecv>() && position + data_size > _memory_recv_max_size) {
+			// too big for memory after all (stream), the rest goes to the file
+			good = objSpillMemoryRecv(o);
+			if (good) {
+				_stats.memory_spills++;
+			}
+		}
 
-			// re-unread a finished transfer
-			msg.emplace_or_replace<Message::Components::TagUnread>();
-			msg.remove<Message::Components::Read>();
+		if (good && o.all_of<ObjComp::Ephemeral::ToxMemoryFile>()) {
+			// already memory, buffering would only copy it twice
+			auto* file_ptr = objGetFile2Write(o);
+			good = file_ptr != nullptr && file_ptr->write(data, position);
+			if (good) {
+				objAddReceivedRange(o, position, data_size);
+			}
+		} else if (good) {
+			auto& wb = o.get_or_emplace<Components::TFTWriteBehind>();
 
-			auto c = _tcm.getContactFriend(friend_number);
-			if (static_cast<bool>(c)) {
-				auto self_c = c.get<Contact::Components::Self>().self;
-				auto& rb = msg.get_or_emplace<Message::Components::ReceivedBy>().ts;
-				rb.try_emplace(self_c, ts); // on completion
+			if (!wb.buffer.empty() && position != wb.position + wb.buffer.size()) {
+				// gap, not contiguous
+				good = objFlushWriteBehind(o);
 			}
 
-			_rmm.throwEventUpdate(msg);
+			if (good) {
+				if (wb.buffer.empty()) {
+					wb.position = position;
+					wb.buffer.reserve(_write_behind_size);
+				}
+				wb.buffer.insert(wb.buffer.end(), data.ptr, data.ptr+data.size);
+
+				if (wb.buffer.size() >= _write_behind_size) {
+					good = objFlushWriteBehind(o);
+				}
+			}
 		}
-	} else {
-		auto* file_ptr = objGetFile2Write(o);
-		if (file_ptr == nullptr || !file_ptr->isGood()) {
-			std::cerr << "TTM error: file not good f" << friend_number << " t" << file_number << ", closing\n";
-			_t.toxFileControl(friend_number, file_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
 
-			// update lookup table
-			toxFriendLookupRemove(o);
+		if (!good) {
+			TOX_LOG_ERROR("TTM") << "file not good f" << friend_number << " t" << file_number << ", closing";
+			_t.toxFileControl(friend_number, file_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
 
-			o.remove<
-				ObjComp::Ephemeral::ToxTransferFriend,
-				Components::TFTFile2
-			>();
+			// update lookup table and free resources
+			toxTransferCleanup(o);
 
 			_os.throwEventUpdate(o);
 			// update messages?
 
-			return true;
+			return;
 		}
-		const auto res = file_ptr->write({data, data_size}, position);
+
 		o.get_or_emplace<ObjComp::Ephemeral::File::TransferStats>().total_down += data_size;
 
-		// queue?
-		_os.throwEventUpdate(o);
+		objProgressUpdate(o);
 		//_rmm.throwEventUpdate(msg);
 	}
-
-	return true;
 }
 
 bool ToxTransferManager::onToxEvent(const Tox_Event_File_Chunk_Request* e) {
@@ -915,59 +2813,504 @@ bool ToxTransferManager::onToxEvent(const Tox_Event_File_Chunk_Request* e) {
 
 	ObjectHandle o = toxFriendLookupSending(friend_number, file_number);
 	if (!static_cast<bool>(o)) {
-		std::cerr << "TTM warning: chunk request for unk ft\n";
+		TOX_LOG_WARNING("TTM") << "chunk request for unk ft";
 		return false; // shrug, we don't know about it, might be someone else's
 	}
 
+	objTouchActivity(o);
+
+	auto& qc = _chunk_queue.emplace_back();
+	qc.o = o.entity();
+	qc.is_request = true;
+	qc.friend_number = friend_number;
+	qc.file_number = file_number;
+	qc.position = position;
+	qc.size = data_size;
+
+	return true;
+}
+
+void ToxTransferManager::handleChunkRequest(ObjectHandle o, const uint32_t friend_number, const uint32_t file_number, const uint64_t position, const uint64_t data_size) {
 	// tox wants us to end the transmission
 	if (data_size == 0) {
-		std::cout << "TTM finished friend " << friend_number << " transfer " << file_number << ", closing\n";
+		TOX_LOG_INFO("TTM") << "finished friend " << friend_number << " transfer " << file_number << ", closing";
 
-		// update lookup table
-		toxFriendLookupRemove(o);
+		objHashFinish(o);
 
-		o.remove<
-			ObjComp::Ephemeral::ToxTransferFriend,
-			Components::TFTFile2
-		>();
+		// update lookup table and free resources
+		toxTransferCleanup(o);
 
 		// TODO: add tag finished?
 		//_rmm.throwEventUpdate(o);
 		_os.throwEventUpdate(o);
+	} else if (o.all_of<Components::TFTStreamBuffer>()) {
+		handleStreamChunkRequest(o, friend_number, file_number, position, data_size);
 	} else {
-		auto* file_ptr = objGetFile2Read(o);
-		if (file_ptr == nullptr || !file_ptr->isGood()) {
-			std::cerr << "TTM error: file not good f" << friend_number << " t" << file_number << ", closing\n";
-			_t.toxFileControl(friend_number, file_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
+		// the receiver resumed (seek), what is before was not sent by this transfer
+		if (auto& tstats = o.get_or_emplace<ObjComp::Ephemeral::File::TransferStats>(); tstats.total_up == 0 && position != 0) {
+			tstats.total_up = position;
+			o.remove<Components::TFTRateWindow>();
+		}
 
-			// update lookup table
-			toxFriendLookupRemove(o);
+		auto* file2_ptr = o.try_get<Components::TFTFile2>();
+		if (file2_ptr == nullptr || file2_ptr->mapped.ptr == nullptr) {
+			// (re)open, also checks the file
+			if (objGetFile2Read(o) == nullptr) {
+				TOX_LOG_ERROR("TTM") << "file not good f" << friend_number << " t" << file_number << ", closing";
+				_t.toxFileControl(friend_number, file_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
 
-			o.remove<
-				ObjComp::Ephemeral::ToxTransferFriend,
-				Components::TFTFile2
-			>();
+				// update lookup table and free resources
+				toxTransferCleanup(o);
 
-			//_rmm.throwEventUpdate(o);
-			_os.throwEventUpdate(o);
-			return true;
+				//_rmm.throwEventUpdate(o);
+				_os.throwEventUpdate(o);
+				return;
+			}
+
+			file2_ptr = &o.get<Components::TFTFile2>();
+			if (!file2_ptr->mapped_checked) {
+				file2_ptr->mapped_checked = true;
+				if (const auto* mmap_ptr = dynamic_cast<const File2MMapR*>(file2_ptr->file.get()); mmap_ptr != nullptr && mmap_ptr->_file_size > 0) {
+					file2_ptr->mapped = mmap_ptr->span(0, uint64_t(mmap_ptr->_file_size));
+				}
+			}
+		} else {
+			file2_ptr->last_activity_ts = _tcm.tickClock().now();
 		}
+		auto* file_ptr = file2_ptr->file.get();
 
-		const auto data = file_ptr->read(data_size, position);
-		if (data.empty()) {
-			std::cerr << "TMM error: failed to read file!!\n";
-			return true;
+		ByteSpan data;
+		if (const ByteSpan mapped = file2_ptr->mapped; mapped.ptr != nullptr) {
+			// already in memory, no read-ahead needed
+			if (position < mapped.size) {
+				data = {mapped.ptr + position, std::min<uint64_t>(data_size, mapped.size - position)};
+			}
+		} else {
+			auto* ra_ptr = o.try_get<Components::TFTReadAhead>();
+			if (ra_ptr == nullptr) {
+				ra_ptr = &o.emplace<Components::TFTReadAhead>();
+				ra_ptr->file_mtime = fileMTime(o);
+			}
+			auto& ra = *ra_ptr;
+
+			uint64_t file_size {UINT64_MAX};
+			if (const auto* si = o.try_get<ObjComp::F::SingleInfo>(); si != nullptr) {
+				file_size = si->file_size;
+			}
+
+			if (!ra.parked.empty()) {
+				// older requests wait for a read, toxcore wants them in order
+				ra.parked.emplace_back(position, data_size);
+				return;
+			} else if (position >= ra.position && position+data_size <= ra.position+blockSize(ra.buffer)) {
+				ra.hits++;
+				_stats.read_ahead_hits++;
+			} else if (ra.next && position >= ra.next_position && position+data_size <= ra.next_position+ra.next->size()) {
+				// read in the background
+				ra.buffer = std::move(ra.next);
+				ra.position = ra.next_position;
+				ra.next.reset();
+
+				ra.hits++;
+				_stats.read_ahead_hits++;
+			} else if (_io && ra.read_pending) {
+				// miss, a read is on the way. parked requests keep their order
+				ra.parked.emplace_back(position, data_size);
+				return;
+			} else {
+				// miss, refill with the (aligned) block(s) containing the chunk
+				const auto [block_pos, read_size] = readAheadBlock(_read_ahead_size, position, data_size, file_size);
+
+				ra.misses++;
+				_stats.read_ahead_misses++;
+
+				if (auto cached = objReadCacheGet(o, block_pos, read_size); cached) {
+					// another transfer of the same file read it
+					ra.buffer = std::move(cached);
+					ra.position = block_pos;
+
+					_stats.read_cache_hits++;
+				} else if (_io) {
+					// wait for the block and handle this request again
+					ra.parked.emplace_back(position, data_size);
+					objSubmitRead(o, block_pos, read_size);
+					return;
+				} else {
+					ra.buffer = std::make_shared<const std::vector<uint8_t>>(ToxTransferIO::takeReadResult(file_ptr->read(read_size, block_pos)));
+					ra.position = block_pos;
+
+					objReadCachePut(o, block_pos, ra.buffer);
+				}
+			}
+
+			// prefetch the next block once half of the current one is sent
+			if (
+				_io && _read_ahead_size != 0 &&
+				!ra.read_pending && !ra.next &&
+				position+data_size > ra.position + blockSize(ra.buffer)/2
+			) {
+				const uint64_t next_pos = ra.position + blockSize(ra.buffer);
+				if (next_pos < file_size) {
+					const uint64_t next_size = std::min<uint64_t>(_read_ahead_size, file_size - next_pos);
+					if (auto cached = objReadCacheGet(o, next_pos, next_size); cached) {
+						ra.next = std::move(cached);
+						ra.next_position = next_pos;
+						_stats.read_cache_hits++;
+					} else {
+						objSubmitRead(o, next_pos, next_size);
+					}
+				}
+			}
+
+			if (position >= ra.position && position < ra.position+blockSize(ra.buffer)) {
+				data = {ra.buffer->data() + (position - ra.position), std::min<uint64_t>(data_size, ra.position+ra.buffer->size()-position)};
+			}
+		}
+
+		if (data.size != data_size) {
+			TOX_LOG_ERROR("TTM") << "failed to read file!!";
+			return;
+		}
+
+		objHashChunk(o, position, data);
+
+		objSendChunk(o, friend_number, file_number, position, data);
+	}
+}
+
+void ToxTransferManager::handleStreamChunkRequest(ObjectHandle o, const uint32_t friend_number, const uint32_t file_number, const uint64_t position, const uint64_t data_size) {
+	auto& sb = o.get<Components::TFTStreamBuffer>();
+
+	if (!sb.waiting.empty()) {
+		// older requests wait for data, toxcore wants them in order
+		sb.waiting.emplace_back(position, data_size);
+		return;
+	}
+
+	if (position < sb.position) {
+		// streams are only requested front to back, already sent
+		TOX_LOG_WARNING("TTM") << "stream chunk request before buffer frd:" << friend_number << " fnb:" << file_number;
+		return;
+	}
+
+	const uint64_t buffer_end = sb.position + sb.available();
+	if (position + data_size > buffer_end && !sb.ended) {
+		// wait for the producer
+		_stats.stream_underruns++;
+		sb.waiting.emplace_back(position, data_size);
+		return;
+	}
+
+	// at the end of the stream, a short chunk (maybe 0) tells the receiver it is done
+	uint64_t send_size = data_size;
+	if (position + send_size > buffer_end) {
+		send_size = position < buffer_end ? buffer_end - position : 0;
+	}
+
+	ByteSpan data;
+	if (send_size != 0) {
+		data = {sb.buffer.data() + sb.consumed + (position - sb.position), send_size};
+	}
+	objHashChunk(o, position, data);
+	objSendChunk(o, friend_number, file_number, position, data);
+	if (!o.all_of<Components::TFTStreamBuffer>()) {
+		return; // canceled on send error
+	}
+
+	// the data is copied if it has to be sent again, drop it
+	const uint64_t done = std::min<uint64_t>(position + send_size - sb.position, sb.available());
+	sb.consumed += done;
+	sb.position += done;
+
+	// move the rest to the front once the sent part is half the buffer
+	if (sb.consumed > sb.buffer.size()/2) {
+		sb.buffer.erase(sb.buffer.begin(), sb.buffer.begin() + sb.consumed);
+		sb.consumed = 0;
+	}
+}
+
+void ToxTransferManager::objServeStreamWaiting(ObjectHandle o) {
+	auto& sb = o.get<Components::TFTStreamBuffer>();
+	if (sb.waiting.empty()) {
+		return;
+	}
+
+	// served right away and in order (not through _chunk_queue, newer requests
+	// of the transfer might already be in there).
+	// if one has to wait again, it and all after it wait again
+	const auto waiting = std::move(sb.waiting);
+	sb.waiting.clear();
+	for (const auto& [position, size] : waiting) {
+		const auto* ttf_ptr = o.try_get<ObjComp::Ephemeral::ToxTransferFriend>();
+		if (ttf_ptr == nullptr || !o.all_of<Components::TFTStreamBuffer>()) {
+			break; // transfer gone
+		}
+
+		handleStreamChunkRequest(o, ttf_ptr->friend_number, ttf_ptr->transfer_number, position, size);
+	}
+}
+
+ObjectHandle ToxTransferManager::toxSendStream(const Contact4 c, uint32_t file_kind, std::string_view name, std::vector<uint8_t> file_id) {
+	const auto& cr = _cs.registry();
+	if (!cr.any_of<Contact::Components::ToxFriendEphemeral, Contact::Components::ToxFriendPersistent>(c)) {
+		TOX_LOG_ERROR("TTM") << "unsupported contact type";
+		return {};
+	}
+
+	if (file_id.empty()) {
+		file_id.resize(32);
+		randombytes_buf(file_id.data(), file_id.size());
+	} else if (file_id.size() != 32) {
+		// trunc or pad with zero
+		file_id.resize(32);
+	}
+
+	auto o = _os.objectHandle(_os.registry().create());
+
+	o.emplace<ObjComp::Tox::TagOutgoing>();
+	o.emplace<ObjComp::Ephemeral::ToxContact>(_cs.contactHandle(c));
+	o.emplace<ObjComp::Tox::FileKind>(file_kind);
+	o.emplace<ObjComp::Tox::FileID>(file_id);
+
+	// unknown size
+	o.emplace<ObjComp::F::SingleInfo>(std::string{name}, UINT64_MAX);
+
+	o.emplace<ObjComp::Ephemeral::File::TransferStats>();
+	o.emplace<ObjComp::Ephemeral::File::TagTransferPaused>();
+
+	o.emplace<Components::TFTStreamBuffer>().buffer.reserve(_stream_buffer_size);
+
+	objSendOrQueue(o, c);
+
+	_os.throwEventConstruct(o);
+
+	return o;
+}
+
+int64_t ToxTransferManager::streamWrite(ObjectHandle stream, ByteSpan data) {
+	const int64_t writable = streamWritable(stream);
+	if (writable <= 0) {
+		return writable; // closed or full
+	}
+
+	auto& sb = stream.get<Components::TFTStreamBuffer>();
+	const uint64_t size = std::min<uint64_t>(data.size, uint64_t(writable));
+	if (size == 0) {
+		return 0;
+	}
+
+	sb.buffer.insert(sb.buffer.end(), data.ptr, data.ptr + size);
+
+	objServeStreamWaiting(stream);
+
+	return int64_t(size);
+}
+
+int64_t ToxTransferManager::streamWritable(ObjectHandle stream) const {
+	// the buffer goes away with the transfer
+	if (!static_cast<bool>(stream)) {
+		return -1;
+	}
+	const auto* sb_ptr = stream.try_get<Components::TFTStreamBuffer>();
+	if (sb_ptr == nullptr || sb_ptr->ended) {
+		return -1;
+	}
+
+	if (sb_ptr->available() >= _stream_buffer_size) {
+		return 0;
+	}
+
+	return int64_t(_stream_buffer_size - sb_ptr->available());
+}
+
+bool ToxTransferManager::streamEnd(ObjectHandle stream) {
+	auto* sb_ptr = stream.try_get<Components::TFTStreamBuffer>();
+	if (sb_ptr == nullptr) {
+		return false;
+	}
+
+	sb_ptr->ended = true;
+
+	objServeStreamWaiting(stream);
+
+	return true;
+}
+
+void ToxTransferManager::objHashChunk(ObjectHandle o, const uint64_t position, ByteSpan data) {
+	if (!_hash_transfers) {
+		return;
+	}
+
+	auto* hs_ptr = o.try_get<Components::TFTHashState>();
+	if (hs_ptr == nullptr) {
+		if (position != 0 || o.all_of<ObjComp::Tox::ContentHash>()) {
+			return; // resumed, or already known
+		}
+		hs_ptr = &o.emplace<Components::TFTHashState>();
+		crypto_generichash_init(&hs_ptr->state, nullptr, 0, 32);
+	}
+
+	if (!hs_ptr->valid || position < hs_ptr->next_position) {
+		return; // requested again, same data
+	}
+
+	if (position > hs_ptr->next_position) {
+		hs_ptr->valid = false;
+		_stats.hash_abandoned++;
+		return;
+	}
+
+	crypto_generichash_update(&hs_ptr->state, data.ptr, data.size);
+	hs_ptr->next_position += data.size;
+	_stats.hashed_bytes += data.size;
+}
+
+void ToxTransferManager::objHashFinish(ObjectHandle o) {
+	auto* hs_ptr = o.try_get<Components::TFTHashState>();
+	if (hs_ptr == nullptr || !hs_ptr->valid) {
+		return;
+	}
+
+	if (const auto* si = o.try_get<ObjComp::F::SingleInfo>(); si != nullptr && si->file_size != UINT64_MAX && si->file_size != hs_ptr->next_position) {
+		// incomplete
+		_stats.hash_abandoned++;
+		return;
+	}
+
+	auto& ch = o.emplace_or_replace<ObjComp::Tox::ContentHash>();
+	crypto_generichash_final(&hs_ptr->state, ch.hash.data(), ch.hash.size());
+
+	// a mismatch is expected for random ids, nothing to act on
+	if (const auto* fid = o.try_get<ObjComp::Tox::FileID>(); fid != nullptr) {
+		ch.file_id_match = std::equal(ch.hash.cbegin(), ch.hash.cend(), fid->id.data.cbegin(), fid->id.data.cend());
+		if (ch.file_id_match) {
+			TOX_LOG_DEBUG("TTM") << "content of e:" << entt::to_integral(o.entity()) << " matches its file id";
+		}
+	}
+
+	o.remove<Components::TFTHashState>();
+}
+
+void ToxTransferManager::objSendChunk(ObjectHandle o, const uint32_t friend_number, const uint32_t file_number, const uint64_t position, ByteSpan data) {
+	auto* retry_ptr = o.try_get<Components::TFTSendRetry>();
+	if (retry_ptr == nullptr || retry_ptr->chunks.empty()) {
+		// toxFileSendChunk() takes a vector,
+		// copy into the reused buffer, no allocation after warmup
+		if (data.size > _send_chunk_buffer.capacity()) {
+			_stats.chunk_path_allocations++;
 		}
+		_send_chunk_buffer.assign(data.ptr, data.ptr+data.size);
 
-		// TODO: get rid of the data cast and support spans in the tox api
-		const auto err = _t.toxFileSendChunk(friend_number, file_number, position, static_cast<std::vector<uint8_t>>(data));
-		// TODO: investigate if i need to retry if sendq full
+		const auto err = _t.toxFileSendChunk(friend_number, file_number, position, _send_chunk_buffer);
 		if (err == TOX_ERR_FILE_SEND_CHUNK_OK) {
-			o.get_or_emplace<ObjComp::Ephemeral::File::TransferStats>().total_up += data_size;
+			bandwidthCharge(friend_number, data.size);
+			o.get_or_emplace<ObjComp::Ephemeral::File::TransferStats>().total_up += data.size;
+			objProgressUpdate(o);
+			return;
+		} else if (err == TOX_ERR_FILE_SEND_CHUNK_FRIEND_NOT_CONNECTED) {
+			// the connection status event requeues the transfer
+			return;
+		} else if (err != TOX_ERR_FILE_SEND_CHUNK_SENDQ) {
+			// toxcore does not ask for this position again, the transfer would hang
+			TOX_LOG_ERROR("TTM") << "sending chunk failed frd:" << friend_number << " fnb:" << file_number << " err:" << err << ", canceling";
+			_t.toxFileControl(friend_number, file_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
+
+			// update lookup table and free resources
+			toxTransferCleanup(o);
+
 			_os.throwEventUpdate(o);
+			return;
 		}
+
+		_stats.sendq_full++;
+
+		retry_ptr = &o.get_or_emplace<Components::TFTSendRetry>();
+		retry_ptr->attempts = 0;
+		retry_ptr->next_try_ts = _tcm.tickClock().now() + _send_retry_min_ms;
 	}
 
-	return true;
+	// keep the data until toxcore takes it
+	auto& chunk = retry_ptr->chunks.emplace_back();
+	chunk.position = position;
+	if (!_chunk_data_pool.empty()) {
+		chunk.data = std::move(_chunk_data_pool.back());
+		_chunk_data_pool.pop_back();
+	}
+	chunk.data.assign(data.ptr, data.ptr+data.size);
+}
+
+void ToxTransferManager::retrySendChunks(void) {
+	const uint64_t ts_now = _tcm.tickClock().now();
+
+	std::vector<Object> progressed;
+	std::vector<Object> failed;
+	for (const auto& [ov, retry, ttf] : _os.registry().view<Components::TFTSendRetry, ObjComp::Ephemeral::ToxTransferFriend>().each()) {
+		if (retry.chunks.empty() || ts_now < retry.next_try_ts) {
+			continue;
+		}
+
+		uint64_t sent_bytes {0};
+		while (!retry.chunks.empty()) {
+			auto& chunk = retry.chunks.front();
+
+			_stats.send_retries++;
+			const auto err = _t.toxFileSendChunk(ttf.friend_number, ttf.transfer_number, chunk.position, chunk.data);
+			if (err == TOX_ERR_FILE_SEND_CHUNK_SENDQ) {
+				// still full, back off
+				retry.attempts++;
+				const uint64_t delay = std::min<uint64_t>(_send_retry_min_ms << std::min<uint32_t>(retry.attempts, 16), _send_retry_max_ms);
+				retry.next_try_ts = ts_now + delay;
+				break;
+			}
+
+			if (err == TOX_ERR_FILE_SEND_CHUNK_OK) {
+				_stats.send_retries_ok++;
+				sent_bytes += chunk.data.size();
+				retry.attempts = 0;
+			} else {
+				_stats.send_retries_dropped += retry.chunks.size();
+				for (auto& dropped : retry.chunks) {
+					dropped.data.clear();
+					_chunk_data_pool.push_back(std::move(dropped.data));
+				}
+				retry.chunks.clear();
+
+				// toxcore does not ask for these positions again, the transfer would hang.
+				// disconnects are handled by the connection status event
+				if (err != TOX_ERR_FILE_SEND_CHUNK_FRIEND_NOT_CONNECTED) {
+					TOX_LOG_ERROR("TTM") << "resending chunk failed frd:" << ttf.friend_number << " fnb:" << ttf.transfer_number << " err:" << err << ", canceling";
+					failed.push_back(ov);
+				}
+				break;
+			}
+
+			chunk.data.clear();
+			_chunk_data_pool.push_back(std::move(chunk.data));
+			retry.chunks.pop_front();
+		}
+
+		if (sent_bytes != 0) {
+			bandwidthCharge(ttf.friend_number, sent_bytes);
+			_os.registry().get_or_emplace<ObjComp::Ephemeral::File::TransferStats>(ov).total_up += sent_bytes;
+			progressed.push_back(ov);
+		}
+	}
+
+	for (const auto ov : failed) {
+		ObjectHandle o {_os.registry(), ov};
+		const auto [friend_number, transfer_number] = o.get<ObjComp::Ephemeral::ToxTransferFriend>();
+		_t.toxFileControl(friend_number, transfer_number, Tox_File_Control::TOX_FILE_CONTROL_CANCEL);
+
+		// update lookup table and free resources
+		toxTransferCleanup(o);
+	}
+
+	// event handlers might modify the storage
+	for (const auto ov : progressed) {
+		objProgressUpdate({_os.registry(), ov});
+	}
+	for (const auto ov : failed) {
+		_os.throwEventUpdate({_os.registry(), ov});
+	}
 }
 
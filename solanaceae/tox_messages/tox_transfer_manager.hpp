@@ -4,8 +4,12 @@
 #include <solanaceae/object_store/object_store.hpp>
 #include <solanaceae/message3/registry_message_model.hpp>
 #include <solanaceae/tox_contacts/tox_contact_model2.hpp>
+#include <solanaceae/tox_util/token_bucket.hpp>
 
 #include "./backends/tox_ft_filesystem.hpp"
+#include "./backends/tox_ft_memory.hpp"
+#include "./tox_transfer_io.hpp"
+#include "./tox_block_cache.hpp"
 
 //#include <solanaceae/file/file2.hpp>
 // fwd
@@ -14,7 +18,11 @@ struct File2I;
 #include <entt/container/dense_map.hpp>
 
 #include <string_view>
+#include <cstring>
 #include <memory>
+#include <vector>
+#include <deque>
+#include <array>
 
 // fwd
 struct ToxI;
@@ -23,6 +31,88 @@ class ToxTransferManager : public RegistryMessageModelEventI, public ObjectStore
 	public:
 		static constexpr const char* version {"4"};
 
+		enum class StallAction {
+			cancel, // frees everything
+			pause, // keeps the transfer, but closes the file and drops buffers
+		};
+
+		struct Stats {
+			// outgoing chunk requests served from the read-ahead buffer
+			// (or after waiting for a background read)
+			uint64_t read_ahead_hits {0};
+			// requests that caused a read
+			uint64_t read_ahead_misses {0};
+			// blocks taken from the shared read cache instead of reading the file
+			uint64_t read_cache_hits {0};
+
+			// heap allocations on the chunk send path (buffer growth),
+			// stays flat once the buffers reached their working size
+			uint64_t chunk_path_allocations {0};
+
+			// coalesced writes of incoming chunks
+			uint64_t write_behind_writes {0};
+
+			// jobs handed to the io worker(s)
+			uint64_t io_async_reads {0};
+			uint64_t io_async_writes {0};
+
+			// idle file handles closed to stay within the budget
+			uint64_t file_evictions {0};
+			// evicted files opened again on demand
+			uint64_t file_reopens {0};
+
+			// transfers without chunk activity for the stall timeout
+			uint64_t transfers_timed_out {0};
+
+			// chunk requests held back by the bandwidth limits
+			uint64_t throttled_chunks {0};
+			uint64_t throttled_bytes {0};
+
+			// chunks toxcore did not take because its send queue was full
+			uint64_t sendq_full {0};
+			// resend attempts, the successful ones and given up chunks
+			uint64_t send_retries {0};
+			uint64_t send_retries_ok {0};
+			uint64_t send_retries_dropped {0};
+
+			// data fed into transfer content hashes
+			uint64_t hashed_bytes {0};
+			// transfers that could not be hashed, because data was not in order
+			uint64_t hash_abandoned {0};
+
+			// incoming files we already had, not downloaded again
+			uint64_t dedupe_hits {0};
+			uint64_t dedupe_bytes_saved {0};
+
+			// avatars received into memory, and offers served from the cache
+			uint64_t avatar_recvs {0};
+			uint64_t avatar_cache_hits {0};
+
+			// chunk requests of streams that had to wait for the producer
+			uint64_t stream_underruns {0};
+
+			// receive files with reserved disk space
+			uint64_t files_preallocated {0};
+			// finished receives with missing data
+			uint64_t verify_failed {0};
+
+			// small incoming files received into memory first
+			uint64_t memory_recvs {0};
+			// of those, written to disk before the end (grew too big)
+			uint64_t memory_spills {0};
+		};
+
+		// sum of the ToxTransferRate of all active transfers of a friend
+		struct FriendRate {
+			float up {0.f};
+			float down {0.f};
+			float up_avg {0.f};
+			float down_avg {0.f};
+			// until all transfers are done, negative if unknown
+			float eta {-1.f};
+			uint32_t transfers {0};
+		};
+
 	protected:
 		RegistryMessageModelI& _rmm;
 		RegistryMessageModelI::SubscriptionReference _rmm_sr;
@@ -35,11 +125,146 @@ class ToxTransferManager : public RegistryMessageModelEventI, public ObjectStore
 
 		// TODO: remove
 		Backends::ToxFTFilesystem _ftb;
+		// avatars and small incoming files
+		Backends::ToxFTMemory _ftm;
 
 		bool _in_obj_update_event {false};
 
 		entt::dense_map<uint64_t, ObjectHandle> _friend_sending_lookup;
 		entt::dense_map<uint64_t, ObjectHandle> _friend_receiving_lookup;
+		// all transfers (both directions) in the lookups, by friend
+		entt::dense_map<uint32_t, std::vector<Object>> _friend_transfers;
+
+		struct FileIDHash {
+			size_t operator()(const std::array<uint8_t, 32>& id) const noexcept {
+				// ids are random or hashes
+				size_t h;
+				std::memcpy(&h, id.data(), sizeof(h));
+				return h;
+			}
+		};
+		// complete (LocalHaveAll) objects by FileID, checked on use
+		entt::dense_map<std::array<uint8_t, 32>, std::vector<Object>, FileIDHash> _have_all_index;
+		// partially received (ReceivedRanges) incoming objects by FileID, checked on use
+		entt::dense_map<std::array<uint8_t, 32>, std::vector<Object>, FileIDHash> _resumable_index;
+
+		// receive files at least this big get their disk space reserved up front
+		uint64_t _preallocate_min_size {1024*1024};
+
+		// incoming files up to this size are received into memory and written to
+		// their path in one go once the transfer ends. streams start in memory too
+		uint64_t _memory_recv_max_size {256*1024};
+
+		// data buffered per outgoing stream, streamWrite() accepts no more
+		uint64_t _stream_buffer_size {1024*1024};
+
+		// avatars up to this size are auto accepted into memory
+		uint64_t _avatar_max_size {64*1024};
+		// received avatars by FileID (the avatar hash), oldest evicted first
+		entt::dense_map<std::array<uint8_t, 32>, std::shared_ptr<std::vector<uint8_t>>, FileIDHash> _avatar_cache;
+		std::deque<std::array<uint8_t, 32>> _avatar_cache_order;
+		uint64_t _avatar_cache_bytes {0};
+		uint64_t _avatar_cache_max_bytes {16*1024*1024};
+		// latest avatar object by contact, the previous one is released if it is memory only
+		entt::dense_map<Contact4, Object> _avatar_objects;
+
+		// outgoing transfers not yet offered, in order, by contact
+		entt::dense_map<Contact4, std::deque<Object>> _send_queue;
+		// offered but not finished outgoing transfers per friend,
+		// the rest stays queued. 0 means unlimited
+		size_t _max_active_sends {4};
+
+		// running (unpaused) transfers, the scheduler pauses the rest.
+		// ordered by ToxTransferPriority, then by bytes left. 0 means unlimited
+		size_t _max_running_transfers {16};
+		size_t _max_running_transfers_friend {4};
+		uint64_t _last_schedule_ts {0};
+		// new admissions start with this friend, rotates for fairness
+		uint32_t _schedule_next_friend {0};
+
+		// outgoing file data limits, in bytes per second
+		ToxTokenBucket _bandwidth_bucket;
+		uint64_t _friend_bandwidth_default {0};
+		entt::dense_map<uint32_t, uint64_t> _friend_bandwidth_limits;
+		entt::dense_map<uint32_t, ToxTokenBucket> _friend_buckets;
+
+		// chunk events are not handled in the event callback, but queued and
+		// processed in iterate() within a time budget.
+		// this way control and message events of the same tick (including
+		// other subscribers like the ToxMessageManager) are not delayed by disk io
+		struct QueuedChunk {
+			Object o {entt::null}; // to detect reused transfer numbers
+			bool is_request {false}; // otherwise recv
+			uint32_t friend_number {0};
+			uint32_t file_number {0};
+			uint64_t position {0};
+			uint64_t size {0}; // requested size, or size of data
+			std::vector<uint8_t> data; // recv only
+		};
+		std::deque<QueuedChunk> _chunk_queue;
+		// chunk requests over the bandwidth limit, served in order per friend
+		entt::dense_map<uint32_t, std::deque<QueuedChunk>> _throttled_chunks;
+		// recycled data buffers of processed chunks
+		std::vector<std::vector<uint8_t>> _chunk_data_pool;
+
+		// hash transfers on the fly (ContentHash)
+		bool _hash_transfers {true};
+
+		// resend delay after a full send queue, doubled on each failure
+		uint64_t _send_retry_min_ms {5};
+		uint64_t _send_retry_max_ms {250};
+
+		// in microseconds per iterate(), 0 means unlimited
+		uint64_t _chunk_budget_us {4000};
+
+		// outgoing transfers read the file in blocks of this size
+		uint64_t _read_ahead_size {256*1024};
+
+		// read-ahead blocks shared between transfers of the same file.
+		// mmaped files are not cached, they share the page cache already
+		ToxBlockCache _read_cache;
+
+		// incoming contiguous chunks are buffered up to this size before writing
+		uint64_t _write_behind_size {256*1024};
+
+		// ToxI takes a vector, reused for every chunk sent
+		std::vector<uint8_t> _send_chunk_buffer;
+
+		// file reads and writes off the event thread, nullptr for synchronous io
+		std::unique_ptr<ToxTransferIO> _io;
+		// recycled write-behind buffers
+		std::vector<std::vector<uint8_t>> _write_buffer_pool;
+
+		// open file handles of transfers, least recently used are closed first.
+		// 0 means unlimited
+		size_t _max_open_files {64};
+		// handles unused for this long are closed regardless, 0 disables
+		uint64_t _file_idle_timeout_ms {60*1000};
+		uint64_t _last_file_sweep_ts {0};
+
+		// unpaused transfers without chunk activity for this long are
+		// handled according to _stall_action, 0 disables
+		uint64_t _stall_timeout_ms {5*60*1000};
+		StallAction _stall_action {StallAction::cancel};
+		// active transfers, one slot per second.
+		// entries are checked when their slot comes up and either time out
+		// or are moved to the slot they are due next
+		std::array<std::vector<Object>, 64> _stall_wheel;
+		uint64_t _stall_wheel_ts {0}; // in seconds, time of the current slot
+		size_t _stall_wheel_pos {0};
+
+		// min time between progress (chunk) updates of a transfer,
+		// state changes are always thrown immediately. 0 updates on every chunk
+		uint64_t _progress_interval_ms {100};
+
+		// transfer rates are derived from the TransferStats deltas over this window
+		uint64_t _rate_window_ms {1000};
+		// weight of the newest window in the moving average
+		float _rate_ewma_alpha {0.3f};
+		uint64_t _last_rate_ts {0};
+		entt::dense_map<uint32_t, FriendRate> _friend_rates;
+
+		Stats _stats;
 
 	protected:
 		void toxFriendLookupAdd(ObjectHandle o);
@@ -48,8 +273,113 @@ class ToxTransferManager : public RegistryMessageModelEventI, public ObjectStore
 		ObjectHandle toxFriendLookupSending(const uint32_t friend_number, const uint32_t file_number) const;
 		ObjectHandle toxFriendLookupReceiving(const uint32_t friend_number, const uint32_t file_number) const;
 
+		// removes lookup entry and ephemeral transfer state (file, buffers)
+		void toxTransferCleanup(ObjectHandle o);
+
+		// writes out buffered incoming chunks, false on error
+		bool objFlushWriteBehind(ObjectHandle o);
+		// marks [position, position+size) as written
+		void objAddReceivedRange(ObjectHandle o, const uint64_t position, const uint64_t size);
+
+		// adds o to the resumable index if it is a partially received object
+		void objIndexResumable(ObjectHandle o);
+
+		// sets up receiving into file_path (or memory, if small enough), truncated
+		bool objOpenRecvFile(ObjectHandle o, std::string_view file_path, const uint64_t file_size);
+		// receives into memory (ToxFTMemory) instead of the file, false if not applicable
+		bool objRecvIntoMemory(ObjectHandle o, const uint64_t file_size);
+		// writes the memory received so far to SingleInfoLocal and moves o back to
+		// ToxFTFilesystem. on failure the data stays in memory. noop for other objects
+		bool objSpillMemoryRecv(ObjectHandle o);
+		// accepted, incomplete and inactive incoming object with the same file, if any.
+		// the ranges are only kept across restarts if the meta backend of the object
+		// persists them (see nj/tox_obj_components_serializer.hpp), ToxFTFilesystem does not
+		ObjectHandle findResumableRecv(const Contact4 c, const std::vector<uint8_t>& file_id, const uint64_t file_size);
+		// attaches the new transfer to o and seeks to the first missing byte
+		bool resumeRecv(ObjectHandle o, const uint32_t friend_number, const uint32_t file_number);
+
+		// adds o to the FileID index if it is complete
+		void objIndexHaveAll(ObjectHandle o);
+		// complete object with the file, if any. only objects of the same contact,
+		// or with the content verified against the FileID (ContentHash::file_id_match)
+		ObjectHandle findHaveAll(const Contact4 c, const std::vector<uint8_t>& file_id, const uint64_t file_size);
+
+		// avatar offers, served from the cache or received into memory
+		void recvAvatar(const ContactHandle4 c, const uint32_t friend_number, const uint32_t file_number, const uint64_t file_size, std::string_view file_name, const std::vector<uint8_t>& file_id);
+		void avatarCacheAdd(const std::array<uint8_t, 32>& id, std::shared_ptr<std::vector<uint8_t>> data);
+		// avatar in ToxFTMemory, not (yet) written to disk
+		bool objIsMemoryAvatar(ObjectHandle o) const;
+		// accept() of a memory avatar, written through to disk once complete
+		bool acceptAvatar(ObjectHandle o, std::string_view file_path, bool path_is_file);
+		// writes the data to SingleInfoLocal and moves o to the filesystem backend
+		bool objAvatarToDisk(ObjectHandle o);
+		// o is the new avatar of c, destroys the previous one unless it went to disk
+		void objReleaseAvatar(const Contact4 c, ObjectHandle o);
+
+		// offers o to the friend now if possible, otherwise queues it
+		void objSendOrQueue(ObjectHandle o, const Contact4 c);
+		// false if the friend can not take it right now
+		bool objSendOffer(ObjectHandle o, const uint32_t friend_number, bool& retry);
+		size_t activeSendCount(const uint32_t friend_number) const;
+		// offers queued transfers of online friends
+		void dispatchSendQueue(void);
+
+		// pauses/resumes transfers to stay within the running limits
+		void scheduleTransfers(void);
+
+		// async read into the read-ahead buffer
+		void objSubmitRead(ObjectHandle o, const uint64_t position, const uint64_t size);
+
+		// shared read cache, by the objects local file
+		ToxBlockCache::Block objReadCacheGet(ObjectHandle o, const uint64_t position, const uint64_t size);
+		void objReadCachePut(ObjectHandle o, const uint64_t position, ToxBlockCache::Block data);
+		void processIOCompletions(void);
+
 		File2I* objGetFile2Write(ObjectHandle o);
 		File2I* objGetFile2Read(ObjectHandle o);
+		// closes idle and least recently used files over the budget
+		void closeIdleFiles(void);
+
+		// marks chunk/control activity, (re)arms the stall timer
+		void objTouchActivity(ObjectHandle o);
+		void stallWheelInsert(Object ov, const uint64_t due_ms);
+		void processStalledTransfers(void);
+		void handleStall(ObjectHandle o);
+
+		// throws an object update, or defers it to keep within the progress interval
+		void objProgressUpdate(ObjectHandle o);
+		void flushProgressUpdates(void);
+
+		// ToxTransferRate and friend rates, once per window
+		void updateTransferRates(void);
+
+		void processChunkQueue(void);
+		// false if the chunk was deferred
+		bool processQueuedChunk(QueuedChunk& qc, bool from_throttled);
+		// both the global and the friend limit allow sending size bytes now
+		bool bandwidthAvailable(const uint32_t friend_number, const uint64_t size);
+		// takes the tokens, once toxcore accepted the data
+		void bandwidthCharge(const uint32_t friend_number, const uint64_t size);
+		bool bandwidthLimited(void) const;
+		ToxTokenBucket& friendBucket(const uint32_t friend_number);
+		void serveThrottledChunks(void);
+
+		// feeds in-order data into the transfer hash
+		void objHashChunk(ObjectHandle o, const uint64_t position, ByteSpan data);
+		// emplaces ContentHash if all data was hashed
+		void objHashFinish(ObjectHandle o);
+
+		// sends the chunk or queues it behind earlier failed ones
+		void objSendChunk(ObjectHandle o, const uint32_t friend_number, const uint32_t file_number, const uint64_t position, ByteSpan data);
+		// resends chunks rejected with a full send queue
+		void retrySendChunks(void);
+		void finishRecv(ObjectHandle o, const uint32_t friend_number);
+		void handleRecvChunk(ObjectHandle o, const uint32_t friend_number, const uint32_t file_number, const uint64_t position, ByteSpan data);
+		void handleChunkRequest(ObjectHandle o, const uint32_t friend_number, const uint32_t file_number, const uint64_t position, const uint64_t data_size);
+		// outgoing stream, served from the producer buffer
+		void handleStreamChunkRequest(ObjectHandle o, const uint32_t friend_number, const uint32_t file_number, const uint64_t position, const uint64_t data_size);
+		// serves the chunk requests that waited for stream data, in order
+		void objServeStreamWaiting(ObjectHandle o);
 
 	public:
 		ToxTransferManager(
@@ -64,9 +394,83 @@ class ToxTransferManager : public RegistryMessageModelEventI, public ObjectStore
 
 		virtual void iterate(void);
 
+		// time spent per iterate() on queued file chunks, 0 for unlimited
+		void setChunkBudget(uint64_t budget_us) { _chunk_budget_us = budget_us; }
+		size_t chunkQueueSize(void) const { return _chunk_queue.size(); }
+
+		// block size for reading outgoing files, 0 reads only the requested chunk
+		void setReadAheadSize(uint64_t size) { _read_ahead_size = size; }
+		// 0 disables the shared read cache
+		void setReadCacheSize(uint64_t max_bytes) { _read_cache.setMaxBytes(max_bytes); }
+		// outgoing files at least this big are memory mapped (File2MMapR), eg 4MiB.
+		// off (UINT64_MAX) by default, a file truncated while being sent crashes (SIGBUS)
+		void setMMapThreshold(uint64_t size) { _ftb.setMMapThreshold(size); }
+		// buffer size for writing incoming files, 0 writes every chunk
+		void setWriteBehindSize(uint64_t size) { _write_behind_size = size; }
+		// number of io worker threads, 0 for synchronous io (default).
+		// fails while io is in flight
+		bool setAsyncIO(size_t thread_count);
+		// closed files are reopened through the object backend when needed
+		void setMaxOpenFiles(size_t max_open_files) { _max_open_files = max_open_files; }
+		void setFileIdleTimeout(uint64_t timeout_ms) { _file_idle_timeout_ms = timeout_ms; }
+		// outgoing transfers offered at once per friend, 0 for unlimited
+		void setMaxActiveSends(size_t max_active_sends) { _max_active_sends = max_active_sends; }
+		size_t sendQueueSize(const Contact4 c) const;
+
+		void setHashTransfers(bool hash) { _hash_transfers = hash; }
+
+		// UINT64_MAX disables preallocation
+		void setPreallocateMinSize(uint64_t size) { _preallocate_min_size = size; }
+
+		// 0 disables receiving into memory
+		void setMemoryRecvMaxSize(uint64_t size) { _memory_recv_max_size = size; }
+
+		// every byte of the incoming file was written (ReceivedRanges, persisted with the meta).
+		// without ranges, only TagLocalHaveAll counts. empty files are always complete
+		bool isVerifiedComplete(ObjectHandle o) const;
+
+		// 0 sends avatars through the generic path
+		void setAvatarMaxSize(uint64_t size) { _avatar_max_size = size; }
+		void setAvatarCacheSize(uint64_t max_bytes) { _avatar_cache_max_bytes = max_bytes; }
+
+		// outgoing file data in bytes per second, 0 for unlimited.
+		// can be changed at any time
+		void setBandwidthLimit(uint64_t rate);
+		// applies to every friend without an own limit
+		void setFriendBandwidthLimit(uint64_t rate);
+		void setFriendBandwidthLimit(uint32_t friend_number, uint64_t rate);
+		size_t throttledChunkCount(void) const;
+
+		// running transfers in total and per friend, 0 for unlimited
+		void setMaxRunningTransfers(size_t total, size_t per_friend) { _max_running_transfers = total; _max_running_transfers_friend = per_friend; }
+
+		// 0 disables stall detection
+		void setStallTimeout(uint64_t timeout_ms) { _stall_timeout_ms = timeout_ms; }
+		void setStallAction(StallAction action) { _stall_action = action; }
+		// eg. 100 for 10Hz, 0 for every chunk
+		void setProgressInterval(uint64_t interval_ms) { _progress_interval_ms = interval_ms; }
+
+		const Stats& stats(void) const { return _stats; }
+
+		// nullptr if the friend has no active transfers
+		const FriendRate* friendRate(uint32_t friend_number) const;
+
 	public: // TODO: private?
 		Message3Handle toxSendFilePath(const Contact4 c, uint32_t file_kind, std::string_view file_name, std::string_view file_path, std::vector<uint8_t> file_id = {});
 
+		// sends a stream of unknown size (UINT64_MAX), fed through streamWrite().
+		// the object is sent/queued like a file, but not kept
+		ObjectHandle toxSendStream(const Contact4 c, uint32_t file_kind, std::string_view name, std::vector<uint8_t> file_id = {});
+		// appends as much as fits into the stream buffer, returns the bytes taken.
+		// less than data.size means the buffer is full, try again later.
+		// -1 if the stream is closed (ended, canceled or gone), stop writing
+		int64_t streamWrite(ObjectHandle stream, ByteSpan data);
+		// space left in the stream buffer, -1 if closed
+		int64_t streamWritable(ObjectHandle stream) const;
+		// no more data, the receiver is told once everything is sent
+		bool streamEnd(ObjectHandle stream);
+		void setStreamBufferSize(uint64_t size) { _stream_buffer_size = size; }
+
 		bool resume(ObjectHandle transfer);
 		bool pause(ObjectHandle transfer);
 		// move to "file" backend?
@@ -84,13 +488,13 @@ class ToxTransferManager : public RegistryMessageModelEventI, public ObjectStore
 		// needs to have:
 		// - StorageBackendIFile2
 		// - SingleInfo
-		// - LocalHaveAll (TODO: figure out streaming?)
+		// - LocalHaveAll (streams go through toxSendStream())
 		// - Tox::FileID (defaults to obj id? rng?)
 		// - Tox::FileKind (defaults to 0(DATA) )
 		bool sendFileObj(const Contact4 c, ObjectHandle o) override;
 
 	protected: // os
-		//bool onEvent(const ObjectStore::Events::ObjectConstruct&) override;
+		bool onEvent(const ObjectStore::Events::ObjectConstruct&) override;
 		bool onEvent(const ObjectStore::Events::ObjectUpdate&) override;
 		bool onEvent(const ObjectStore::Events::ObjectDestory&) override;
 
@@ -0,0 +1,163 @@
+#include "./log.hpp"
+
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <cstring>
+
+namespace ToxLog {
+
+std::atomic<Level> g_runtime_level {Level::info};
+
+namespace {
+
+	struct Record {
+		Level level {Level::info};
+		uint16_t size {0};
+		char text[Line::max_size];
+	};
+
+	// bounded mpsc queue (vyukov), producers never block
+	class Sink {
+		static constexpr size_t _slot_count {1024}; // power of 2
+
+		struct Slot {
+			std::atomic<size_t> seq;
+			Record rec;
+		};
+
+		std::unique_ptr<Slot[]> _slots;
+		alignas(64) std::atomic<size_t> _enqueue_pos {0};
+		alignas(64) size_t _dequeue_pos {0}; // consumer only
+		std::atomic<size_t> _written_pos {0};
+
+		std::atomic<uint64_t> _dropped {0};
+		std::atomic<bool> _quit {false};
+		std::thread _thread;
+
+		bool pop(Record& rec) {
+			Slot& slot = _slots[_dequeue_pos & (_slot_count-1)];
+			if (slot.seq.load(std::memory_order_acquire) != _dequeue_pos+1) {
+				return false; // empty
+			}
+
+			rec = slot.rec;
+			slot.seq.store(_dequeue_pos + _slot_count, std::memory_order_release);
+			_dequeue_pos++;
+			return true;
+		}
+
+		void drain(void) {
+			Record rec;
+			while (pop(rec)) {
+				// keep the old cout/cerr split
+				FILE* out = rec.level >= Level::warning ? stderr : stdout;
+				std::fwrite(rec.text, 1, rec.size, out);
+				std::fputc('\n', out);
+				_written_pos.store(_dequeue_pos, std::memory_order_release);
+			}
+			std::fflush(stdout);
+			std::fflush(stderr);
+		}
+
+		void run(void) {
+			while (!_quit.load(std::memory_order_acquire)) {
+				drain();
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			}
+			drain();
+		}
+
+	public:
+		Sink(void) : _slots(new Slot[_slot_count]) {
+			for (size_t i = 0; i < _slot_count; i++) {
+				_slots[i].seq.store(i, std::memory_order_relaxed);
+			}
+			_thread = std::thread([this]() { run(); });
+		}
+
+		~Sink(void) {
+			_quit.store(true, std::memory_order_release);
+			if (_thread.joinable()) {
+				_thread.join();
+			}
+		}
+
+		void push(Level level, const char* text, uint16_t size) {
+			size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+			Slot* slot {nullptr};
+			for (;;) {
+				slot = &_slots[pos & (_slot_count-1)];
+				const size_t seq = slot->seq.load(std::memory_order_acquire);
+				const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+				if (diff == 0) {
+					if (_enqueue_pos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+						break;
+					}
+				} else if (diff < 0) {
+					// full, rather lose a line than block the event loop
+					_dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				} else {
+					pos = _enqueue_pos.load(std::memory_order_relaxed);
+				}
+			}
+
+			slot->rec.level = level;
+			slot->rec.size = size;
+			std::memcpy(slot->rec.text, text, size);
+			slot->seq.store(pos+1, std::memory_order_release);
+		}
+
+		uint64_t dropped(void) const {
+			return _dropped.load(std::memory_order_relaxed);
+		}
+
+		void flush(void) {
+			const size_t target = _enqueue_pos.load(std::memory_order_acquire);
+			while (_written_pos.load(std::memory_order_acquire) < target) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+	};
+
+	Sink& sink(void) {
+		static Sink s;
+		return s;
+	}
+
+	constexpr std::string_view levelString(Level level) {
+		switch (level) {
+			case Level::trace: return "trace";
+			case Level::debug: return "debug";
+			case Level::info: return "info";
+			case Level::warning: return "warning";
+			case Level::error: return "error";
+			default: return "";
+		}
+	}
+
+} // namespace
+
+uint64_t droppedLines(void) {
+	return sink().dropped();
+}
+
+void flush(void) {
+	sink().flush();
+}
+
+Line::Line(Level level, std::string_view tag) : _level(level) {
+	// "TTM error: ..."
+	append(tag);
+	append(" ");
+	append(levelString(level));
+	append(": ");
+}
+
+Line::~Line(void) {
+	sink().push(_level, _buf, _size);
+}
+
+} // ToxLog
+
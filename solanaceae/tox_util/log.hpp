@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <string_view>
+#include <type_traits>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+
+// lightweight logger for the tox event handlers.
+// lines are formatted into a fixed buffer on the calling thread and handed to
+// a lock-free queue, a background thread writes them out.
+// filtered at compile time (SOLANACEAE_TOX_LOG_COMPILE_LEVEL) and at runtime (setLevel()).
+// usage: TOX_LOG_INFO("TTM") << "accepted " << id;
+
+namespace ToxLog {
+
+	enum class Level : uint8_t {
+		trace = 0,
+		debug,
+		info,
+		warning,
+		error,
+		none, // filter only
+	};
+
+#ifndef SOLANACEAE_TOX_LOG_COMPILE_LEVEL
+	#define SOLANACEAE_TOX_LOG_COMPILE_LEVEL 1 // debug
+#endif
+
+	constexpr Level compile_level {static_cast<Level>(SOLANACEAE_TOX_LOG_COMPILE_LEVEL)};
+
+	extern std::atomic<Level> g_runtime_level;
+
+	inline void setLevel(Level level) { g_runtime_level.store(level, std::memory_order_relaxed); }
+	inline Level getLevel(void) { return g_runtime_level.load(std::memory_order_relaxed); }
+
+	inline bool enabled(Level level) {
+		// first comparison is constant and folds away
+		return level >= compile_level && level >= g_runtime_level.load(std::memory_order_relaxed);
+	}
+
+	// lines that did not fit into the queue
+	uint64_t droppedLines(void);
+
+	// blocks until all queued lines are written
+	void flush(void);
+
+	class Line {
+		public:
+			static constexpr size_t max_size {480};
+
+		private:
+			Level _level;
+			uint16_t _size {0};
+			char _buf[max_size];
+
+			void append(std::string_view sv) {
+				const size_t n = std::min<size_t>(sv.size(), max_size - _size);
+				for (size_t i = 0; i < n; i++) {
+					_buf[_size+i] = sv[i];
+				}
+				_size += n;
+			}
+
+		public:
+			Line(Level level, std::string_view tag);
+			~Line(void); // pushes the line to the sink
+
+			Line(const Line&) = delete;
+			Line& operator=(const Line&) = delete;
+
+			template<typename T>
+			Line& operator<<(const T& v) {
+				if constexpr (std::is_same_v<T, char>) {
+					append({&v, 1});
+				} else if constexpr (std::is_same_v<T, bool>) {
+					append(v ? "true" : "false");
+				} else if constexpr (std::is_integral_v<T>) {
+					const auto res = std::to_chars(_buf+_size, _buf+max_size, v);
+					_size = res.ptr - _buf; // on error, ptr is end
+				} else if constexpr (std::is_enum_v<T>) {
+					*this << static_cast<std::underlying_type_t<T>>(v);
+				} else if constexpr (std::is_floating_point_v<T>) {
+					char tmp[32];
+					const int n = std::snprintf(tmp, sizeof(tmp), "%g", static_cast<double>(v));
+					if (n > 0) {
+						append({tmp, std::min<size_t>(n, sizeof(tmp)-1)});
+					}
+				} else if constexpr (std::is_pointer_v<T> && !std::is_convertible_v<const T&, std::string_view>) {
+					char tmp[24];
+					const int n = std::snprintf(tmp, sizeof(tmp), "%p", static_cast<const void*>(v));
+					if (n > 0) {
+						append({tmp, std::min<size_t>(n, sizeof(tmp)-1)});
+					}
+				} else {
+					static_assert(std::is_convertible_v<const T&, std::string_view>, "type not loggable");
+					append(std::string_view{v});
+				}
+				return *this;
+			}
+	};
+
+} // ToxLog
+
+#define SOLANACEAE_TOX_LOG(level, tag) \
+	if (!::ToxLog::enabled(level)) {} else ::ToxLog::Line{level, tag}
+
+#define TOX_LOG_TRACE(tag) SOLANACEAE_TOX_LOG(::ToxLog::Level::trace, tag)
+#define TOX_LOG_DEBUG(tag) SOLANACEAE_TOX_LOG(::ToxLog::Level::debug, tag)
+#define TOX_LOG_INFO(tag) SOLANACEAE_TOX_LOG(::ToxLog::Level::info, tag)
+#define TOX_LOG_WARNING(tag) SOLANACEAE_TOX_LOG(::ToxLog::Level::warning, tag)
+#define TOX_LOG_ERROR(tag) SOLANACEAE_TOX_LOG(::ToxLog::Level::error, tag)
+
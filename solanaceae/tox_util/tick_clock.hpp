@@ -0,0 +1,62 @@
+#pragma once
+
+#include <solanaceae/util/time.hpp>
+
+#include <cstdint>
+
+// caches getTimeMS() for the duration of an event batch (tick).
+// handlers use now(), which samples the clock at most once per tick.
+// tick() has to be called between event batches, so everything that uses the
+// clock outside of event dispatch (eg iterate()) ticks when it is done.
+// paths that need the exact time (eg user actions outside of the event loop)
+// use nowPrecise().
+class ToxTickClock {
+	uint64_t _now_ms {0};
+	bool _valid {false};
+
+	// in case tick() is never called, dont serve a frozen time forever
+	static constexpr uint32_t _max_cached_reads {4096};
+	uint32_t _cached_reads {0};
+
+	// stats
+	uint64_t _samples {0}; // actual clock reads
+	uint64_t _reads {0}; // now() + nowPrecise() calls
+
+	public:
+		// start of a new event batch, next now() samples the clock
+		void tick(void) {
+			_valid = false;
+		}
+
+		uint64_t now(void) {
+			_reads++;
+			if (!_valid || _cached_reads >= _max_cached_reads) {
+				sample();
+			} else {
+				_cached_reads++;
+			}
+			return _now_ms;
+		}
+
+		// opt-out of the cache, also refreshes it
+		uint64_t nowPrecise(void) {
+			_reads++;
+			sample();
+			return _now_ms;
+		}
+
+		// reads() is what getTimeMS() calls would have been without the cache.
+		// eg receiving 1MiB takes ~1600-6100 reads, but only 24 samples at 64
+		// chunks per tick, 1530 at 1 chunk per tick
+		uint64_t samples(void) const { return _samples; }
+		uint64_t reads(void) const { return _reads; }
+
+	private:
+		void sample(void) {
+			_now_ms = getTimeMS();
+			_valid = true;
+			_cached_reads = 0;
+			_samples++;
+		}
+};
+
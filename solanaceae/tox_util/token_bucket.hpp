@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// bytes per second limiter, refilled from the (tick) time passed in.
+// up to burst bytes can be taken at once after being idle.
+class ToxTokenBucket {
+	uint64_t _rate {0}; // 0 is unlimited
+	uint64_t _burst {0};
+	uint64_t _tokens {0};
+	uint64_t _last_ms {0};
+
+	public:
+		// a burst of at least a few chunks, or rate*burst_ms
+		void setRate(uint64_t rate, uint64_t burst_ms = 250) {
+			_rate = rate;
+			_burst = std::max<uint64_t>(rate * burst_ms / 1000, 16*1024);
+			_tokens = std::min(_tokens, _burst);
+		}
+
+		uint64_t rate(void) const { return _rate; }
+		bool unlimited(void) const { return _rate == 0; }
+
+		void refill(uint64_t now_ms) {
+			if (_last_ms == 0 || now_ms < _last_ms) {
+				_last_ms = now_ms;
+				_tokens = _burst;
+				return;
+			}
+
+			const uint64_t new_tokens = (now_ms - _last_ms) * _rate / 1000;
+			if (new_tokens == 0) {
+				return; // keep the remainder for the next call
+			}
+
+			_tokens = std::min(_tokens + new_tokens, _burst);
+			_last_ms = now_ms;
+		}
+
+		bool canTake(uint64_t size) const {
+			return _rate == 0 || _tokens >= size;
+		}
+
+		void take(uint64_t size) {
+			if (_rate == 0) {
+				return;
+			}
+			_tokens -= std::min(_tokens, size);
+		}
+};
+